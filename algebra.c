@@ -1,100 +1,171 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "qspc.h"
 
-/* Computes the Cauchy product of two truncated series.
- *   series1: Coefficients of the first series.
- *   series2: Coefficients of the second series.
- *   result: Where the coefficients of the product is written.
- *   bound: The length of each of these arrays. */
-static void truncated_product(int64_t *series1, int64_t *series2,
-			      int64_t *result, int64_t bound)
+/* Unless stated otherwise, the functions here work with int64_t coefficients
+ * and check every operation for overflow. Those that can overflow return
+ * false if any coefficient did, in which case their results are garbage. */
+
+/* The following kernels multiply or divide a truncated series in place by a
+ * single binomial $1 \pm q^k$, in time linear in the bound. Each returns
+ * false on overflow.
+ *   power: The value k, which must be at least 1.
+ *   series: The coefficients of the series, which are overwritten.
+ *   bound: The length of this array. */
+static inline bool multiply_one_minus(int64_t power, int64_t *series,
+				      int64_t bound)
 {
-	for (int64_t index1 = 0; index1 < bound; ++index1) {
-		result[index1] = 0;
+	bool overflow = false;
+
+	/* Run backwards so that each coefficient read is still the old one. */
+	for (int64_t index = bound - 1; index >= power; --index) {
+		overflow |= __builtin_sub_overflow(series[index],
+						   series[index - power],
+						   &series[index]);
+	}
 
-		for (int64_t index2 = 0; index2 <= index1; ++index2) {
-			result[index1] += series1[index1 - index2]
-					* series2[index2];
+	return !overflow;
+}
+
+static inline bool multiply_one_plus(int64_t power, int64_t *series,
+				     int64_t bound)
+{
+	bool overflow = false;
+
+	for (int64_t index = bound - 1; index >= power; --index) {
+		overflow |= __builtin_add_overflow(series[index],
+						   series[index - power],
+						   &series[index]);
+	}
+
+	return !overflow;
+}
+
+static inline bool divide_one_minus(int64_t power, int64_t *series,
+				    int64_t bound)
+{
+	bool overflow = false;
+
+	/* Run forwards, since the quotient satisfies
+	 * $r_n = s_n + r_{n-k}$ for $1 / (1 - q^k)$. */
+	for (int64_t index = power; index < bound; ++index) {
+		overflow |= __builtin_add_overflow(series[index],
+						   series[index - power],
+						   &series[index]);
+	}
+
+	return !overflow;
+}
+
+static inline bool divide_one_plus(int64_t power, int64_t *series,
+				   int64_t bound)
+{
+	bool overflow = false;
+
+	for (int64_t index = power; index < bound; ++index) {
+		overflow |= __builtin_sub_overflow(series[index],
+						   series[index - power],
+						   &series[index]);
+	}
+
+	return !overflow;
+}
+
+/* Multiplies a truncated series in place by the numerator q-Pochhammer
+ * symbol $(\pm q^a; q^b)_n$. Returns false on overflow.
+ *   dilation1: The value a, which must be at least 1.
+ *   dilation2: The value b, which must be at least 1.
+ *   factors: The value n, which can be 0.
+ *   sign: Set to 1 or -1 to give the sign in front of $q^a$.
+ *   series: The coefficients of the series, which are overwritten.
+ *   bound: The length of this array. */
+static bool multiply_q_pochhammer(int64_t dilation1, int64_t dilation2,
+				  int64_t factors, int64_t sign,
+				  int64_t *series, int64_t bound)
+{
+	bool success = true;
+
+	for (int64_t index = 0; index < factors; ++index) {
+		int64_t power = index * dilation2 + dilation1;
+
+		if (power >= bound) break;
+
+		if (sign == 1) {
+			success &= multiply_one_minus(power, series, bound);
+		} else {
+			success &= multiply_one_plus(power, series, bound);
+		}
+	}
+
+	return success;
+}
+
+/* Divides a truncated series in place by the q-Pochhammer symbol
+ * $(\pm q^a; q^b)_n$. The parameters and return value are the same as for
+ * multiply_q_pochhammer. */
+static bool divide_q_pochhammer(int64_t dilation1, int64_t dilation2,
+				int64_t factors, int64_t sign,
+				int64_t *series, int64_t bound)
+{
+	bool success = true;
+
+	for (int64_t index = 0; index < factors; ++index) {
+		int64_t power = index * dilation2 + dilation1;
+
+		if (power >= bound) break;
+
+		if (sign == 1) {
+			success &= divide_one_minus(power, series, bound);
+		} else {
+			success &= divide_one_plus(power, series, bound);
 		}
 	}
+
+	return success;
 }
 
 /* Computes the coefficients of a q-Pochhammer symbol in the numerator
- * of the form $(\pm q^a; q^b)_n$.
- *   dilation1: The value a, which can be 0.
- *   dilation2: The value b, which must be at least 1. 
- *   factors: The value n, which can be 0. 
+ * of the form $(\pm q^a; q^b)_n$. Returns false on overflow.
+ *   dilation1: The value a, which must be at least 1.
+ *   dilation2: The value b, which must be at least 1.
+ *   factors: The value n, which can be 0.
  *   sign: Set to 1 or -1 to give the sign in front of $q^a$.
  *   result: The array of coefficients the product is written to.
  *   bound: The length of this array. The product is truncated to fit, and
  *     zeroes are padded if the result is smaller. */
-static void expand_q_pochhammer_num(int64_t dilation1, int64_t dilation2,
-				    int64_t factors, int64_t sign,
-				    int64_t *result, int64_t bound)
+bool QSPC_expand_q_pochhammer_num(int64_t dilation1, int64_t dilation2,
+				  int64_t factors, int64_t sign,
+				  int64_t *result, int64_t bound)
 {
-	int64_t buffer[bound];
-
 	result[0] = 1;
 
 	for (int64_t index = 1; index < bound; ++index) result[index] = 0;
 
-	for (int64_t index1 = 0; index1 < factors; ++index1) {
-		int64_t offset = index1 * dilation2 + dilation1;
-
-		if (offset >= bound) break;
-
-		/* Multiplication here is simple enough to avoid needing
-		 * to use truncated_product. */
-		for (int64_t index = 0; index < bound - offset; ++index)
-			buffer[index] = result[index];
-
-		for (int64_t index = 0; index < bound - offset; ++index)
-			result[index + offset] -= sign * buffer[index];
-	}
+	return multiply_q_pochhammer(dilation1, dilation2, factors, sign,
+				     result, bound);
 }
 
 /* Computes the coefficients of a q-Pochhammer symbol in the denominator.
- * of the form $(\pm q^a; q^b)_n^{-1}$.
+ * of the form $(\pm q^a; q^b)_n^{-1}$. Returns false on overflow.
  *   dilation1: The value a, which must be at least 1.
- *   dilation2: The value b, which must be at least 1. 
- *   factors: The value n, which can be 0. 
+ *   dilation2: The value b, which must be at least 1.
+ *   factors: The value n, which can be 0.
  *   sign: Set to 1 or -1 to give the sign in front of $q^a$.
  *   result: The array of coefficients the product is written to.
  *   bound: The length of this array. The product is truncated to fit. */
-static void expand_q_pochhammer_den(int64_t dilation1,
-				    int64_t dilation2,
-				    int64_t factors, int64_t sign,
-				    int64_t *result, int64_t bound)
+bool QSPC_expand_q_pochhammer_den(int64_t dilation1, int64_t dilation2,
+				  int64_t factors, int64_t sign,
+				  int64_t *result, int64_t bound)
 {
 	result[0] = 1;
 
 	for (int64_t index = 1; index < bound; ++index) result[index] = 0;
 
-	for (int64_t index1 = 0; index1 < factors; ++index1) {
-		int64_t buffer1[bound];
-		int64_t buffer2[bound];
-
-		for (int64_t index2 = 0; index2 < bound; ++index2) {
-			buffer1[index2] = 0;
-			buffer2[index2] = result[index2];
-		}
-
-		if (sign == 1) {
-			for (int64_t index2 = 0; index2 < bound; index2
-			     += dilation2 * index1 + dilation1)
-				buffer1[index2] = 1;
-		} else {
-			int64_t flip = 1;
-
-			for (int64_t index2 = 0; index2 < bound;
-			     index2 += dilation2 * index1 + dilation1) {
-				flip = (flip == 1) ? -1 : 1;
-				buffer1[index2] = flip;
-			}
-		}
-
-		truncated_product(buffer1, buffer2, result, bound);
-	}
+	return divide_q_pochhammer(dilation1, dilation2, factors, sign,
+				   result, bound);
 }
 
 /* Returns the degree of the q-Multinomial coefficient.
@@ -113,22 +184,20 @@ static inline int64_t q_multinomial_degree(int64_t top, int64_t *bottom,
 	return degree;
 }
 
-/* Computes the q-Multinomial coefficient.
+/* Computes the q-Multinomial coefficient. Returns false on overflow.
  *   top: The parameter on the top in the q-Multinomial.
  *   bottom: An array of the parameters on the bottom in the q-Multinomial.
  *   length: The number of parameters on the bottom.
  *   result: Where the coefficients of the result are written.
  *   bound: The length of this array. If the result is smaller, zeroes are
  *     padded at the end, and otherwise the result is truncated to fit. */
-static void expand_q_multinomial(int64_t top, int64_t *bottom,
-				 int64_t length, int64_t *result,
-				 int64_t bound)
+bool QSPC_expand_q_multinomial(int64_t top, int64_t *bottom, int64_t length,
+			       int64_t *result, int64_t bound)
 {
 	int64_t degree = q_multinomial_degree(top, bottom, length);
 	int64_t adj_bound = (degree <= bound) ? degree + 1 : bound;
-	int64_t buffer1[adj_bound];
-	int64_t buffer2[adj_bound];
 	int64_t bottom_sum = 0;
+	bool success;
 
 	/* If the bottom parameters do not exactly sum to top, the result
 	 * is taken by convention to be 0. */
@@ -139,179 +208,605 @@ static void expand_q_multinomial(int64_t top, int64_t *bottom,
 		for (int64_t index = 0; index < bound; ++index)
 			result[index] = 0;
 
-		return;
+		return true;
 	}
 
 	result[0] = 1;
 
 	for (int64_t index = 1; index < bound; ++index) result[index] = 0;
 
-	for (int64_t index1 = 0; index1 < length; ++index1) {
-		for (int64_t index2 = 0; index2 < adj_bound; ++index2)
-			buffer2[index2] = result[index2];
+	/* Every coefficient past the degree is zero, so there is no need to
+	 * carry them through the division. */
+	success = multiply_q_pochhammer(1, 1, top, 1, result, adj_bound);
 
-		expand_q_pochhammer_den(1, 1, bottom[index1], 1,
-					 buffer1, adj_bound);
-		truncated_product(buffer1, buffer2, result, adj_bound);
+	for (int64_t index = 0; index < length; ++index) {
+		success &= divide_q_pochhammer(1, 1, bottom[index], 1, result,
+					       adj_bound);
 	}
 
-	for (int64_t index = 0; index < adj_bound; ++index)
-		buffer2[index] = result[index];
-
-	expand_q_pochhammer_num(1, 1, top, 1, buffer1, adj_bound);
-	truncated_product(buffer1, buffer2, result, adj_bound);
+	return success;
 }
 
-/* Computes the q-Binomial coefficient.
+/* Computes the q-Binomial coefficient. Returns false on overflow.
  *   top: The parameter on the top of the q-Binomial.
  *   bottom: The parameter on the bottom of the q-Binomial.
  *   result: The array of coefficients the result is written to.
  *   bound: The length of this array. */
-static inline void expand_q_binomial(int64_t top, int64_t bottom,
+static inline bool expand_q_binomial(int64_t top, int64_t bottom,
 				     int64_t *result, int64_t bound)
 {
 	if (bottom > top) {
 		for (int64_t index = 0; index < bound; ++index)
 			result[index] = 0;
+
+		return true;
 	} else {
 		int64_t parameters[2] = {bottom, top - bottom};
 
-		expand_q_multinomial(top, parameters, 2, result, bound);
+		return QSPC_expand_q_multinomial(top, parameters, 2, result,
+						 bound);
 	}
 }
 
-extern int64_t QSPC_divisors(int64_t, int64_t **);
+extern int64_t QSPC_mobius_divisors(struct QSPC_context *, int64_t,
+				    int64_t **, int64_t **);
+extern int64_t QSPC_arena_mark(void);
+extern void *QSPC_arena_alloc(int64_t);
+extern void QSPC_arena_release(int64_t);
 
 /* Uniquely factors a truncated series with constant term 1 into a product of
  * geometric series so that when expanded, the coefficients match up to the
  * bound. This product takes the form $\prod_{k=1}^n \frac{1}{(1-q^k)^{a_k}}$.
+ * Returns bound on success. On overflow, this stops and returns the index of
+ * the power that overflowed, and every power before it is still exact.
+ *   context: The context whose divisors are used.
  *   series: The series to be factored.
  *   powers: The list of geometric series powers $a_k$. The first term $a_0$
  *     is taken to be 0 for convenience.
  *   bound: The length of the series array. The highest power coefficient that
  *     is guaranteed to match is that of $q^n$, where $n$ is one less than
  *     the value of bound. */
-void QSPC_find_product_form(int64_t *series, int64_t *powers, int64_t bound)
+int64_t QSPC_find_product_form(struct QSPC_context *context, int64_t *series,
+			       int64_t *powers, int64_t bound)
 {
-	/* Assume bound is at least 2. */
+	/* The logarithmic derivative $q f'/f = \sum_n b_n q^n$ of the series,
+	 * where $b_n = \sum_{d \mid n} d a_d$. */
+	int64_t mark = QSPC_arena_mark();
+	int64_t *derivative = QSPC_arena_alloc(bound
+					       * (int64_t)sizeof(int64_t));
+	int64_t exact = bound;
+
 	powers[0] = 0;
-	powers[1] = series[1];
 
-	/* This algorithm is derived from observations in the book The Theory
-	 * of Partitions by George Andrews. */
+	/* Each $b_n$ follows from $q f' = f \cdot q f'/f$, one term of the
+	 * convolution at a time, and $a_n$ from $b_n$ by Mobius inversion.
+	 * This takes time $O(n^2)$ overall. */
 	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		int64_t value;
 		int64_t power = 0;
+		int64_t term;
 		int64_t length;
 		int64_t *divisors;
+		int64_t *signs;
+		bool overflow = __builtin_mul_overflow(index1, series[index1],
+						       &value);
 
 		for (int64_t index2 = 1; index2 < index1; ++index2) {
-			length = QSPC_divisors(index2, &divisors);
+			overflow |= __builtin_mul_overflow(derivative[index2],
+				series[index1 - index2], &term);
+			overflow |= __builtin_sub_overflow(value, term, &value);
+		}
+
+		derivative[index1] = value;
+		length = QSPC_mobius_divisors(context, index1, &divisors,
+					      &signs);
 
-			for (int64_t index3 = 0; index3 < length; ++index3) {
-				power -= series[index1 - index2]
-				      * divisors[index3]
-				      * powers[divisors[index3]];
+		for (int64_t index2 = 0; index2 < length; ++index2) {
+			term = derivative[divisors[index2]];
+
+			if (signs[index2] > 0) {
+				overflow |= __builtin_add_overflow(power, term,
+								   &power);
+			} else {
+				overflow |= __builtin_sub_overflow(power, term,
+								   &power);
 			}
 		}
 
-		length = QSPC_divisors(index1, &divisors);
-
-		for (int64_t index2 = 0; index2 < length - 1; ++index2) {
-			power -= divisors[index2] * powers[divisors[index2]];
+		if (overflow) {
+			exact = index1;
+			break;
 		}
 
-		power /= index1;
-		power += series[index1];
-		powers[index1] = power;
+		powers[index1] = power / index1;
 	}
+
+	QSPC_arena_release(mark);
+
+	return exact;
 }
 
-/* Helper function for QSPC_build_series. Finds the contributions to the
- * series given by a particular summation index.
- *   parameters: The parameters that encode the series. 
- *   result: The array the coefficients of the terms are written to.
- *   bound: The length of this array.
+/* Helper function for QSPC_build_series. Multiplies the running product of
+ * q-Pochhammer symbols for one summation index by just the factors that are
+ * needed for the next, so that $(q^a;q^b)_{cn+d}$ never has to be expanded
+ * from scratch. Returns false on overflow.
+ *   parameters: The parameters that encode the series.
+ *   factors: The number of factors of each symbol already in the product,
+ *     numerator symbols first. These are updated.
+ *   term: The running product. This is updated in place.
+ *   bound: The number of coefficients of term to keep.
  *   summation_index: The index of the term being computed. */
-static void build_series_term(int64_t *parameters, int64_t *result,
-			      int64_t bound, int64_t summation_index)
+static bool extend_series_term(int64_t *parameters, int64_t *factors,
+			       int64_t *term, int64_t bound,
+			       int64_t summation_index)
 {
-	int64_t buffer1[bound];
-	int64_t buffer2[bound];
+	bool success = true;
 
-	result[0] = 1;
+	for (int64_t index1 = 0; index1 < 2 * QSPC_MAX_NUM_QPS; ++index1) {
+		int64_t *symbol = &parameters[4 * index1];
+		int64_t target = symbol[0] * summation_index + symbol[1];
+		int64_t dilation1 = symbol[2] + symbol[3] * factors[index1];
 
-	for (int64_t index = 1; index < bound; ++index) result[index] = 0;
+		/* Skip to the denominator on the first empty symbol. */
+		if (symbol[0] == 0) {
+			if (index1 >= QSPC_MAX_NUM_QPS) break;
+
+			index1 = QSPC_MAX_NUM_QPS - 1;
+			continue;
+		}
+
+		if (target <= factors[index1]) continue;
+
+		if (index1 < QSPC_MAX_NUM_QPS) {
+			success &= multiply_q_pochhammer(dilation1, symbol[3],
+							 target
+							 - factors[index1],
+							 -1, term, bound);
+		} else {
+			success &= divide_q_pochhammer(dilation1, symbol[3],
+						       target
+						       - factors[index1],
+						       1, term, bound);
+		}
+
+		factors[index1] = target;
+	}
+
+	return success;
+}
+
+/* Helper function for QSPC_build_series. Adds a summand into the series at
+ * the given offset and with the given sign. Returns false on overflow. */
+static inline bool add_series_term(int64_t *term, int64_t *result,
+				   int64_t offset, int64_t flip,
+				   int64_t bound)
+{
+	bool overflow = false;
+
+	if (flip == 1) {
+		for (int64_t index = 0; index < bound - offset; ++index) {
+			overflow |= __builtin_add_overflow(
+				result[index + offset], term[index],
+				&result[index + offset]);
+		}
+	} else {
+		for (int64_t index = 0; index < bound - offset; ++index) {
+			overflow |= __builtin_sub_overflow(
+				result[index + offset], term[index],
+				&result[index + offset]);
+		}
+	}
+
+	return !overflow;
+}
+
+/* The q-Pochhammer symbols of a parameter combination are shared by every
+ * choice of the leading power and sign, so the products they give for each
+ * summation index are cached. Every power the search generates grows at
+ * least as fast as $n(n+1)/2$, so summand n of an entry only needs to keep
+ * the coefficient bound less n(n+1)/2 coefficients, and summands are stored
+ * back to back until this runs out. */
+struct series_cache_entry
+{
+	/* Readers share the entry, and a miss replaces it outright. */
+	pthread_rwlock_t lock;
+
+	/* Set once the entry holds a set of summands. */
+	bool valid;
+
+	/* Set if the summands overflowed, so that they cannot be used. */
+	bool overflow;
 
-	for (int64_t index1 = 0; index1 < QSPC_MAX_NUM_QPS; ++index1) {
-		for (int64_t index2 = 0; index2 < bound; ++index2)
-			buffer1[index2] = result[index2];
+	/* The q-Pochhammer part of the parameters of the summands. */
+	int64_t key[8 * QSPC_MAX_NUM_QPS];
 
-		if (parameters[4 * index1 + 0] == 0) break;
+	/* The summands, allocated the first time the entry is filled. */
+	int64_t *terms;
+};
 
-		expand_q_pochhammer_num(parameters[4 * index1 + 2],
-					parameters[4 * index1 + 3],
-					parameters[4 * index1 + 0]
-					* summation_index
-					+ parameters[4 * index1 + 1],
-					-1, buffer2, bound);
-		truncated_product(buffer1, buffer2, result, bound);
+/* The state a context keeps for building and factoring series. */
+struct QSPC_algebra
+{
+	struct series_cache_entry cache[QSPC_SERIES_CACHE_SIZE];
+	int64_t cache_entries;
+	atomic_int_fast64_t cache_hits;
+	atomic_int_fast64_t cache_misses;
+
+	/* The combinations QSPC_series_powers moved to wider arithmetic. */
+	atomic_int_fast64_t wide_combinations;
+	atomic_int_fast64_t modular_combinations;
+	atomic_int_fast64_t failed_combinations;
+	atomic_int_fast64_t mismatched_combinations;
+};
+
+/* Returns the least power the summand with a given index can have for the
+ * series to use the cache. */
+static inline int64_t cached_offset(int64_t summation_index)
+{
+	return summation_index * (summation_index + 1) / 2;
+}
+
+/* Returns the number of coefficients stored for all the cached summands. */
+static int64_t cached_length(struct QSPC_context *context)
+{
+	int64_t bound = context->config.coefficient_bound;
+	int64_t length = 0;
+
+	for (int64_t index = 0; cached_offset(index) < bound; ++index)
+		length += bound - cached_offset(index);
+
+	return length;
+}
+
+/* Sets up the cache of series summands of a context, and the counts of
+ * combinations moved to wider arithmetic. Called when the context is
+ * created. */
+void QSPC_create_series_cache(struct QSPC_context *context)
+{
+	struct QSPC_algebra *algebra = malloc(sizeof(struct QSPC_algebra));
+	int64_t entry_size = cached_length(context) * (int64_t)sizeof(int64_t);
+
+	/* Only as many entries are used as fit in the memory allowed, which
+	 * can be none at large bounds. */
+	algebra->cache_entries = QSPC_SERIES_CACHE_BYTES / entry_size;
+
+	if (algebra->cache_entries > QSPC_SERIES_CACHE_SIZE)
+		algebra->cache_entries = QSPC_SERIES_CACHE_SIZE;
+
+	for (int64_t index = 0; index < QSPC_SERIES_CACHE_SIZE; ++index) {
+		pthread_rwlock_init(&algebra->cache[index].lock, NULL);
+		algebra->cache[index].valid = false;
+		algebra->cache[index].terms = NULL;
 	}
 
-	for (int64_t index1 = 0; index1 < QSPC_MAX_NUM_QPS; ++index1) {
-		for (int64_t index2 = 0; index2 < bound; ++index2)
-			buffer1[index2] = result[index2];
-
-		if (parameters[4 * QSPC_MAX_NUM_QPS
-		    + 4 * index1 + 0] == 0) break;
-
-		expand_q_pochhammer_den(parameters[4 * QSPC_MAX_NUM_QPS
-					+ 4 * index1 + 2],
-					parameters[4 * QSPC_MAX_NUM_QPS
-					+ 4 * index1 + 3],
-					parameters[4 * QSPC_MAX_NUM_QPS
-					+ 4 * index1 + 0]
-					* summation_index
-					+ parameters[4 * QSPC_MAX_NUM_QPS
-					+ 4 * index1 + 1],
-					1, buffer2, bound);
-		truncated_product(buffer1, buffer2, result, bound);
+	atomic_init(&algebra->cache_hits, 0);
+	atomic_init(&algebra->cache_misses, 0);
+	atomic_init(&algebra->wide_combinations, 0);
+	atomic_init(&algebra->modular_combinations, 0);
+	atomic_init(&algebra->failed_combinations, 0);
+	atomic_init(&algebra->mismatched_combinations, 0);
+	context->algebra = algebra;
+}
+
+/* Frees up the cache of series summands of a context. */
+void QSPC_delete_series_cache(struct QSPC_context *context)
+{
+	struct QSPC_algebra *algebra = context->algebra;
+
+	for (int64_t index = 0; index < QSPC_SERIES_CACHE_SIZE; ++index) {
+		pthread_rwlock_destroy(&algebra->cache[index].lock);
+		free(algebra->cache[index].terms);
 	}
+
+	free(algebra);
+}
+
+/* Reports how often QSPC_build_series found its summands in the cache.
+ *   context: The context the series were built in.
+ *   hits: Where the number of lookups that were found is written.
+ *   misses: Where the number of lookups that had to be computed is
+ *     written. */
+void QSPC_series_cache_stats(struct QSPC_context *context, int64_t *hits,
+			     int64_t *misses)
+{
+	*hits = atomic_load(&context->algebra->cache_hits);
+	*misses = atomic_load(&context->algebra->cache_misses);
 }
 
-/* Computes the truncated coefficients of a q-series series.
- *   parameters: The parameters that encode the series. 
+/* Helper function for QSPC_build_series. Picks the cache entry for the
+ * q-Pochhammer part of the parameters. */
+static struct series_cache_entry *find_cache_entry(
+	struct QSPC_context *context, int64_t *parameters)
+{
+	uint64_t hash = 14695981039346656037u;
+
+	for (int64_t index = 0; index < 8 * QSPC_MAX_NUM_QPS; ++index) {
+		hash ^= (uint64_t)parameters[index];
+		hash *= 1099511628211u;
+	}
+
+	return &context->algebra->cache[hash
+		% (uint64_t)context->algebra->cache_entries];
+}
+
+/* Helper function for QSPC_build_series. Computes the summands stored in a
+ * cache entry, one after the other. Returns false on overflow.
+ *   context: The context whose cache holds the entry.
+ *   parameters: The parameters that encode the series.
+ *   terms: Where the summands are written. */
+static bool build_cached_terms(struct QSPC_context *context,
+			       int64_t *parameters, int64_t *terms)
+{
+	int64_t bound = context->config.coefficient_bound;
+	int64_t factors[2 * QSPC_MAX_NUM_QPS];
+	int64_t mark = QSPC_arena_mark();
+	int64_t *term = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	bool success = true;
+
+	for (int64_t index = 0; index < 2 * QSPC_MAX_NUM_QPS; ++index)
+		factors[index] = 0;
+
+	term[0] = 1;
+
+	for (int64_t index = 1; index < bound; ++index) term[index] = 0;
+
+	for (int64_t index1 = 0; cached_offset(index1) < bound; ++index1) {
+		int64_t length = bound - cached_offset(index1);
+
+		success &= extend_series_term(parameters, factors, term,
+					      length, index1);
+
+		for (int64_t index2 = 0; index2 < length; ++index2)
+			terms[index2] = term[index2];
+
+		terms += length;
+	}
+
+	QSPC_arena_release(mark);
+
+	return success;
+}
+
+/* Helper function for QSPC_build_series. Adds up the summands of a series
+ * from a list of them stored as in the cache. Returns false on overflow. */
+static bool sum_cached_terms(struct QSPC_context *context,
+			     int64_t *parameters, int64_t *terms,
+			     int64_t *result)
+{
+	int64_t bound = context->config.coefficient_bound;
+	bool success = true;
+
+	for (int64_t index = 0;; ++index) {
+		int64_t offset = QSPC_series_offset(parameters, index);
+
+		if (offset >= bound) return success;
+
+		success &= add_series_term(terms, result, offset,
+					   QSPC_series_sign(parameters,
+							    index), bound);
+		terms += bound - cached_offset(index);
+	}
+}
+
+/* Helper function for QSPC_build_series. Returns true if the power in front
+ * of each summand grows quickly enough for the series to use the cache. */
+static bool is_cacheable(struct QSPC_context *context, int64_t *parameters,
+			 int64_t bound)
+{
+	if (bound != context->config.coefficient_bound
+	    || context->algebra->cache_entries == 0) return false;
+
+	for (int64_t index = 0; cached_offset(index) < bound; ++index) {
+		if (QSPC_series_offset(parameters, index)
+		    < cached_offset(index)) return false;
+	}
+
+	return true;
+}
+
+/* Computes the truncated coefficients of a q-series series. Each summand is
+ * built from the previous one, which only differs by a few extra factors.
+ * Returns false on overflow.
+ *   context: The context whose cache of summands is used.
+ *   parameters: The parameters that encode the series.
  *   result: The array the coefficients of the terms are written to.
  *   bound: The length of this array, and the number of coefficients found. */
-void QSPC_build_series(int64_t *parameters, int64_t *result, int64_t bound)
+bool QSPC_build_series(struct QSPC_context *context, int64_t *parameters,
+		       int64_t *result, int64_t bound)
 {
+	struct QSPC_algebra *algebra = context->algebra;
+	int64_t factors[2 * QSPC_MAX_NUM_QPS];
+	int64_t mark;
+	int64_t *term;
+	bool success = true;
+
 	for (int64_t index = 0; index < bound; ++index) result[index] = 0;
 
-	for (int64_t index1 = 0;; ++index1) {
-		int64_t offset = (parameters[QSPC_PARAMETER_LENGTH - 4]
-				 * index1 * index1
-				 + parameters[QSPC_PARAMETER_LENGTH - 3]
-				 * index1)
-				 / parameters[QSPC_PARAMETER_LENGTH - 2];
-		int64_t flip;
+	if (is_cacheable(context, parameters, bound)) {
+		struct series_cache_entry *entry;
+		bool hit;
+
+		entry = find_cache_entry(context, parameters);
+		pthread_rwlock_rdlock(&entry->lock);
+		hit = entry->valid;
+
+		for (int64_t index = 0; hit && index < 8
+		     * QSPC_MAX_NUM_QPS; ++index) {
+			if (entry->key[index] != parameters[index])
+				hit = false;
+		}
+
+		if (hit) {
+			success = !entry->overflow && sum_cached_terms(
+				context, parameters, entry->terms, result);
+			pthread_rwlock_unlock(&entry->lock);
+			atomic_fetch_add_explicit(&algebra->cache_hits, 1,
+						  memory_order_relaxed);
+			return success;
+		}
+
+		pthread_rwlock_unlock(&entry->lock);
+		atomic_fetch_add_explicit(&algebra->cache_misses, 1,
+					  memory_order_relaxed);
+
+		/* Replace whatever the entry held before. */
+		pthread_rwlock_wrlock(&entry->lock);
+
+		if (entry->terms == NULL) {
+			entry->terms = malloc((size_t)cached_length(context)
+					      * sizeof(int64_t));
+		}
+
+		for (int64_t index = 0; index < 8 * QSPC_MAX_NUM_QPS; ++index)
+			entry->key[index] = parameters[index];
+
+		entry->overflow = !build_cached_terms(context, parameters,
+						      entry->terms);
+		entry->valid = true;
+		success = !entry->overflow && sum_cached_terms(
+			context, parameters, entry->terms, result);
+		pthread_rwlock_unlock(&entry->lock);
+
+		return success;
+	}
+
+	for (int64_t index = 0; index < 2 * QSPC_MAX_NUM_QPS; ++index)
+		factors[index] = 0;
+
+	mark = QSPC_arena_mark();
+	term = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	term[0] = 1;
+
+	for (int64_t index = 1; index < bound; ++index) term[index] = 0;
+
+	for (int64_t index = 0;; ++index) {
+		int64_t offset = QSPC_series_offset(parameters, index);
 
 		/* This assumes that the power at least weakly grows with the
 		 * summation index. If this is not the case, this can get
 		 * stuck in an infinite loop. */
-		if (offset >= bound) return;
+		if (offset >= bound) break;
+
+		/* Since the offset never shrinks, the running product only
+		 * ever needs to be kept to the length of the current term. */
+		success &= extend_series_term(parameters, factors, term,
+					      bound - offset, index);
+		success &= add_series_term(term, result, offset,
+					   QSPC_series_sign(parameters,
+							    index),
+					   bound);
+	}
 
-		int64_t buffer[bound - offset];
+	QSPC_arena_release(mark);
 
-		build_series_term(parameters, buffer, bound - offset, index1);
+	return success;
+}
 
-		if (parameters[QSPC_PARAMETER_LENGTH - 1]  == -1
-		    && (index1 % 2) == 1) {
-			flip = -1;
-		} else {
-			flip = 1;
+extern bool QSPC_build_series_wide(int64_t *, __int128 *, int64_t);
+extern int64_t QSPC_find_product_form_wide(struct QSPC_context *, __int128 *,
+					   int64_t *, int64_t);
+extern bool QSPC_modular_powers(struct QSPC_context *, int64_t *, int64_t *,
+				int64_t, bool *);
+extern bool QSPC_may_have_pattern(struct QSPC_context *, int64_t *, int64_t);
+
+/* Reports how many combinations QSPC_series_powers had to move to wider
+ * arithmetic.
+ *   context: The context the combinations were searched in.
+ *   wide: Where the number that used __int128 is written.
+ *   modular: Where the number that used modular arithmetic is written.
+ *   failed: Where the number whose powers did not fit is written.
+ *   mismatched: Where the number of those whose powers failed the check
+ *     modulo the last prime is written. */
+void QSPC_arithmetic_stats(struct QSPC_context *context, int64_t *wide,
+			   int64_t *modular, int64_t *failed,
+			   int64_t *mismatched)
+{
+	struct QSPC_algebra *algebra = context->algebra;
+
+	*wide = atomic_load(&algebra->wide_combinations);
+	*modular = atomic_load(&algebra->modular_combinations);
+	*failed = atomic_load(&algebra->failed_combinations);
+	*mismatched = atomic_load(&algebra->mismatched_combinations);
+}
+
+/* Computes the powers of the product form of a q-series, as given by
+ * QSPC_find_product_form. This starts with the arithmetic picked by
+ * QSPC_ARITHMETIC and only moves on to wider arithmetic if that overflows.
+ * Most series that overflow are far from any product, so this is skipped
+ * when the powers found exactly before the overflow already rule out every
+ * pattern that QSPC_find_pattern looks for. Returns false in that case, or
+ * if no arithmetic could find the powers exactly.
+ *   context: The context of the search.
+ *   parameters: The parameters that encode the series.
+ *   series: The coefficients found by QSPC_build_series, or NULL if they
+ *     overflowed.
+ *   powers: The list of powers of the factored series.
+ *   bound: The number of coefficients to use. */
+bool QSPC_series_powers(struct QSPC_context *context, int64_t *parameters,
+			int64_t *series, int64_t *powers, int64_t bound)
+{
+	struct QSPC_algebra *algebra = context->algebra;
+	int64_t exact;
+
+	switch (QSPC_ARITHMETIC) {
+	case QSPC_ARITH_CHECKED:
+		if (series != NULL) {
+			exact = QSPC_find_product_form(context, series, powers,
+						       bound);
+
+			if (exact == bound) return true;
+
+			if (!QSPC_may_have_pattern(context, powers, exact))
+				return false;
+		}
+	/* fall through */
+	case QSPC_ARITH_INT128: {
+		int64_t mark = QSPC_arena_mark();
+		__int128 *wide_series = QSPC_arena_alloc(bound
+			* (int64_t)sizeof(__int128));
+		bool built;
+
+		atomic_fetch_add_explicit(&algebra->wide_combinations, 1,
+					  memory_order_relaxed);
+		built = QSPC_build_series_wide(parameters, wide_series, bound);
+
+		if (built) {
+			exact = QSPC_find_product_form_wide(context,
+							    wide_series,
+							    powers, bound);
 		}
 
-		for (int64_t index2 = 0; index2 < bound - offset; ++index2)
-			result[index2 + offset] += flip * buffer[index2];
+		QSPC_arena_release(mark);
+
+		if (built) {
+			if (exact == bound) return true;
+
+			if (!QSPC_may_have_pattern(context, powers, exact))
+				return false;
+		}
 	}
-}
+	/* fall through */
+	case QSPC_ARITH_MODULAR:
+	default: {
+		bool mismatched;
+
+		atomic_fetch_add_explicit(&algebra->modular_combinations, 1,
+					  memory_order_relaxed);
+
+		if (QSPC_modular_powers(context, parameters, powers, bound,
+					&mismatched))
+			return true;
 
+		atomic_fetch_add_explicit(&algebra->failed_combinations, 1,
+					  memory_order_relaxed);
+
+		if (mismatched) {
+			atomic_fetch_add_explicit(
+				&algebra->mismatched_combinations, 1,
+				memory_order_relaxed);
+		}
+
+		return false;
+	}
+	}
+}
@@ -0,0 +1,101 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+/* Every thread takes the scratch space for its series from an arena of its
+ * own instead of the stack, which would overflow at large bounds. Space is
+ * handed out in order and given back in the reverse order, by going back to
+ * a mark, so taking it is just moving a pointer. The arena is made of blocks
+ * that double in size, taken the first time they are needed and kept until
+ * the thread is done, so once a thread has factored a series of each size
+ * it no longer allocates anything.
+ *
+ * A mark is an offset into the blocks laid end to end, where block i starts
+ * at QSPC_ARENA_SIZE * (2^i - 1). */
+
+/* Enough blocks for any amount of memory a machine could have. */
+#define ARENA_BLOCKS 32
+
+/* Allocations are rounded up to whole cache lines. */
+#define ARENA_ALIGNMENT 64
+
+struct arena
+{
+	char *blocks[ARENA_BLOCKS];
+	int64_t current;
+	int64_t used;
+};
+
+static _Thread_local struct arena thread_arena;
+
+/* Helper functions for the arena. Return the size and the offset of a
+ * block. */
+static inline int64_t block_size(int64_t block)
+{
+	return (int64_t)QSPC_ARENA_SIZE << block;
+}
+
+static inline int64_t block_start(int64_t block)
+{
+	return ((int64_t)QSPC_ARENA_SIZE << block) - QSPC_ARENA_SIZE;
+}
+
+/* Returns a mark for the space taken from the arena of the calling thread so
+ * far, for QSPC_arena_release. */
+int64_t QSPC_arena_mark(void)
+{
+	return block_start(thread_arena.current) + thread_arena.used;
+}
+
+/* Takes space from the arena of the calling thread, aligned to a cache
+ * line. It stays valid until the arena goes back to a mark from before.
+ *   size: The number of bytes needed. */
+void *QSPC_arena_alloc(int64_t size)
+{
+	struct arena *arena = &thread_arena;
+	void *pointer;
+
+	size = (size + ARENA_ALIGNMENT - 1) & -(int64_t)ARENA_ALIGNMENT;
+
+	/* The end of a block is left unused if the space does not fit. */
+	while (arena->used + size > block_size(arena->current)) {
+		++arena->current;
+		arena->used = 0;
+	}
+
+	if (arena->blocks[arena->current] == NULL) {
+		arena->blocks[arena->current] = aligned_alloc(ARENA_ALIGNMENT,
+			(size_t)block_size(arena->current));
+	}
+
+	pointer = arena->blocks[arena->current] + arena->used;
+	arena->used += size;
+
+	return pointer;
+}
+
+/* Gives back all the space taken from the arena of the calling thread since
+ * a mark.
+ *   mark: The mark, from QSPC_arena_mark. */
+void QSPC_arena_release(int64_t mark)
+{
+	struct arena *arena = &thread_arena;
+
+	while (block_start(arena->current) > mark) --arena->current;
+
+	arena->used = mark - block_start(arena->current);
+}
+
+/* Frees up the arena of the calling thread. Called by each thread that
+ * worked on series once it is done. */
+void QSPC_delete_arena(void)
+{
+	for (int64_t index = 0; index < ARENA_BLOCKS; ++index) {
+		free(thread_arena.blocks[index]);
+		thread_arena.blocks[index] = NULL;
+	}
+
+	thread_arena.current = 0;
+	thread_arena.used = 0;
+}
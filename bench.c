@@ -0,0 +1,360 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "qspc.h"
+
+extern bool QSPC_expand_q_pochhammer_num(int64_t, int64_t, int64_t, int64_t,
+					 int64_t *, int64_t);
+extern bool QSPC_expand_q_pochhammer_den(int64_t, int64_t, int64_t, int64_t,
+					 int64_t *, int64_t);
+extern bool QSPC_expand_q_multinomial(int64_t, int64_t *, int64_t, int64_t *,
+				      int64_t);
+
+/* Times the kernels behind the search over a sweep of bounds, and then the
+ * whole search at each thread count up to the number of CPUs. Each
+ * measurement is written to stdout as a line of JSON, with the mean and
+ * standard deviation over a number of samples. */
+
+/* The bounds the kernels are timed at. */
+static const int64_t bench_bounds[] = {50, 100, 200, 400, 800};
+
+#define NUM_BENCH_BOUNDS \
+	((int64_t)(sizeof(bench_bounds) / sizeof(bench_bounds[0])))
+
+/* One more than the largest bound, which no kernel is timed at, so that no
+ * series is ever built through the cache. */
+#define BENCH_MAX_BOUND 801
+
+/* Each kernel is run often enough for a sample to take about this long, and
+ * timed over this many samples. */
+#define BENCH_SAMPLE_NS 10000000.0
+#define BENCH_SAMPLES 10
+
+/* The number of times the search is run for each thread count. */
+#define BENCH_SEARCH_SAMPLES 3
+
+/* The inputs to a kernel being timed. Each kernel only uses some of them. */
+struct bench_case
+{
+	struct QSPC_context *context;
+	const char *kernel;
+	const char *name;
+	int64_t bound;
+	int64_t values[4];
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t *series;
+	int64_t *result;
+	int64_t pattern[QSPC_MAX_SIGNATURE];
+};
+
+/* Returns the time from a monotonic clock in nanoseconds. */
+static double bench_time(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+}
+
+/* Helper function for bench_kernel. Runs a kernel the given number of
+ * times, and returns how long it took in nanoseconds. */
+static double time_kernel(void (*kernel)(struct bench_case *),
+			  struct bench_case *input, int64_t iterations)
+{
+	double start = bench_time();
+
+	for (int64_t index = 0; index < iterations; ++index) kernel(input);
+
+	return bench_time() - start;
+}
+
+/* Times a kernel and writes out the results.
+ *   kernel: Runs the kernel once on the inputs.
+ *   input: The inputs, along with the names to report them by. */
+static void bench_kernel(void (*kernel)(struct bench_case *),
+			 struct bench_case *input)
+{
+	int64_t iterations = 1;
+	double sum = 0.0;
+	double squares = 0.0;
+	double mean;
+	double deviation;
+
+	/* Warm up, and find how many runs make up a sample. */
+	while (time_kernel(kernel, input, iterations) < BENCH_SAMPLE_NS)
+		iterations *= 2;
+
+	for (int64_t sample = 0; sample < BENCH_SAMPLES; ++sample) {
+		double per_op = time_kernel(kernel, input, iterations)
+				/ (double)iterations;
+
+		sum += per_op;
+		squares += per_op * per_op;
+	}
+
+	mean = sum / BENCH_SAMPLES;
+	deviation = sqrt(fmax(squares / BENCH_SAMPLES - mean * mean, 0.0));
+
+	printf("{\"kernel\": \"%s\", \"case\": \"%s\", \"bound\": %lld, "
+	       "\"samples\": %d, \"iterations\": %lld, \"ns_per_op\": %.1f, "
+	       "\"stddev_ns\": %.1f, \"ops_per_second\": %.1f}\n",
+	       input->kernel, input->name, (long long)input->bound,
+	       BENCH_SAMPLES, (long long)iterations, mean, deviation,
+	       1e9 / mean);
+	fflush(stdout);
+}
+
+/* The kernels, each run on the inputs from a bench_case. */
+static void run_pochhammer_num(struct bench_case *input)
+{
+	QSPC_expand_q_pochhammer_num(input->values[0], input->values[1],
+				     input->values[2], input->values[3],
+				     input->result, input->bound);
+}
+
+static void run_pochhammer_den(struct bench_case *input)
+{
+	QSPC_expand_q_pochhammer_den(input->values[0], input->values[1],
+				     input->values[2], input->values[3],
+				     input->result, input->bound);
+}
+
+static void run_multinomial(struct bench_case *input)
+{
+	QSPC_expand_q_multinomial(input->values[0], &input->values[1],
+				  input->values[3] == 0 ? 2 : 3,
+				  input->result, input->bound);
+}
+
+static void run_build_series(struct bench_case *input)
+{
+	QSPC_build_series(input->context, input->parameters, input->result,
+			  input->bound);
+}
+
+static void run_find_product_form(struct bench_case *input)
+{
+	QSPC_find_product_form(input->context, input->series, input->result,
+			       input->bound);
+}
+
+static void run_find_pattern(struct bench_case *input)
+{
+	int64_t exceptions;
+
+	QSPC_find_pattern(input->context, input->series, input->pattern,
+			  &exceptions);
+}
+
+/* Series representative of those searched, as parameters. */
+struct bench_series
+{
+	const char *name;
+	int64_t numerator[4];
+	int64_t denominator[4];
+	int64_t power[4];
+};
+
+static const struct bench_series bench_series[] = {
+	/* $\sum q^{n^2} / (q;q)_n$, the first Rogers-Ramanujan identity. */
+	{"rogers_ramanujan", {0, 0, 0, 0}, {1, 0, 1, 1}, {1, 0, 1, 1}},
+	/* $\sum q^{(n^2+n)/2} (-q;q)_n / (q^2;q^2)_n$. */
+	{"num_den", {1, 0, 1, 1}, {1, 0, 2, 2}, {1, 1, 2, 1}},
+	/* $\sum (-1)^n q^{2n^2+2n} / (q;q)_{2n+1}$. */
+	{"dilated", {0, 0, 0, 0}, {2, 1, 1, 1}, {2, 2, 1, -1}}
+};
+
+#define NUM_BENCH_SERIES \
+	((int64_t)(sizeof(bench_series) / sizeof(bench_series[0])))
+
+/* Helper function for bench_kernels. Fills in the parameters of one of the
+ * representative series. */
+static void set_series(const struct bench_series *series,
+		       int64_t *parameters)
+{
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+		parameters[index] = 0;
+
+	for (int64_t index = 0; index < 4; ++index) {
+		parameters[index] = series->numerator[index];
+		parameters[4 * QSPC_MAX_NUM_QPS + index]
+			= series->denominator[index];
+		parameters[QSPC_PARAMETER_LENGTH - 4 + index]
+			= series->power[index];
+	}
+}
+
+/* Times each kernel at each bound. */
+static void bench_kernels(void)
+{
+	struct QSPC_config config = QSPC_default_config;
+	struct QSPC_context *context;
+	struct bench_case input;
+
+	config.coefficient_bound = BENCH_MAX_BOUND;
+	context = QSPC_create_context(&config);
+
+	for (int64_t bound_index = 0; bound_index < NUM_BENCH_BOUNDS;
+	     ++bound_index) {
+		int64_t bound = bench_bounds[bound_index];
+
+		input.context = context;
+		input.bound = bound;
+		input.series = malloc((size_t)bound * sizeof(int64_t));
+		input.result = malloc((size_t)bound * sizeof(int64_t));
+
+		/* $(-q;q)_n$ with every factor inside the bound, and
+		 * $(q^2;q^3)_n$ with a third of them. */
+		input.kernel = "expand_q_pochhammer_num";
+		input.name = "(-q;q)_n";
+		input.values[0] = 1;
+		input.values[1] = 1;
+		input.values[2] = bound;
+		input.values[3] = 1;
+		bench_kernel(run_pochhammer_num, &input);
+		input.kernel = "expand_q_pochhammer_den";
+		bench_kernel(run_pochhammer_den, &input);
+
+		input.kernel = "expand_q_pochhammer_num";
+		input.name = "(q^2;q^3)_n";
+		input.values[0] = 2;
+		input.values[1] = 3;
+		input.values[2] = bound / 3;
+		input.values[3] = -1;
+		bench_kernel(run_pochhammer_num, &input);
+		input.kernel = "expand_q_pochhammer_den";
+		bench_kernel(run_pochhammer_den, &input);
+
+		input.kernel = "expand_q_multinomial";
+		input.name = "[16;8,8]";
+		input.values[0] = 16;
+		input.values[1] = 8;
+		input.values[2] = 8;
+		input.values[3] = 0;
+		bench_kernel(run_multinomial, &input);
+		input.name = "[18;6,6,6]";
+		input.values[0] = 18;
+		input.values[1] = 6;
+		input.values[2] = 6;
+		input.values[3] = 6;
+		bench_kernel(run_multinomial, &input);
+
+		for (int64_t index = 0; index < NUM_BENCH_SERIES; ++index) {
+			set_series(&bench_series[index], input.parameters);
+			input.kernel = "build_series";
+			input.name = bench_series[index].name;
+			bench_kernel(run_build_series, &input);
+
+			/* Factor the series built above. */
+			QSPC_build_series(context, input.parameters,
+					  input.series, bound);
+			input.kernel = "find_product_form";
+			bench_kernel(run_find_product_form, &input);
+		}
+
+		/* The powers of a product with a pattern of length 5, which
+		 * has to be checked all the way to the bound, and those of
+		 * one with no pattern, which is ruled out quickly. */
+		config.coefficient_bound = bound;
+		input.context = QSPC_create_context(&config);
+
+		for (int64_t index = 0; index < bound; ++index)
+			input.series[index] = index % 5 == 1 || index % 5 == 4;
+
+		input.kernel = "find_pattern";
+		input.name = "period_5";
+		bench_kernel(run_find_pattern, &input);
+
+		for (int64_t index = 0; index < bound; ++index)
+			input.series[index] = index;
+
+		input.name = "no_pattern";
+		bench_kernel(run_find_pattern, &input);
+		QSPC_delete_context(input.context);
+
+		free(input.series);
+		free(input.result);
+	}
+
+	QSPC_delete_context(context);
+	QSPC_delete_arena();
+}
+
+/* Times the whole default search at every number of threads from 1 to the
+ * number of CPUs the process may run on, with the workers pinned in the
+ * order QSPC_create_topology deals them out, so that the rate for each
+ * thread shows where the search stops scaling. The search is run without
+ * hooks, so the identities are thrown away. */
+static void bench_search(void)
+{
+	struct QSPC_config config = QSPC_default_config;
+	struct QSPC_search_hooks hooks = {0};
+	struct QSPC_context *context;
+	double single = 0.0;
+	int64_t cpus;
+
+	/* Leaving the number of threads at 0 counts the CPUs. */
+	config.num_threads = 0;
+	config.cpu_list = "all";
+	context = QSPC_create_context(&config);
+	cpus = context->config.num_threads;
+	QSPC_delete_context(context);
+
+	for (int64_t threads = 1; threads <= cpus; ++threads) {
+		int64_t counters[QSPC_NUM_COUNTERS];
+		double sum = 0.0;
+		double squares = 0.0;
+		double mean;
+		double deviation;
+		double rate;
+
+		config.num_threads = threads;
+
+		for (int64_t sample = 0; sample < BENCH_SEARCH_SAMPLES;
+		     ++sample) {
+			double seconds;
+
+			/* Each sample starts with nothing in the caches. */
+			context = QSPC_create_context(&config);
+			seconds = bench_time();
+			QSPC_run_search(context, &hooks, counters);
+			seconds = (bench_time() - seconds) / 1e9;
+			QSPC_delete_context(context);
+
+			sum += seconds;
+			squares += seconds * seconds;
+		}
+
+		mean = sum / BENCH_SEARCH_SAMPLES;
+		deviation = sqrt(fmax(squares / BENCH_SEARCH_SAMPLES
+				      - mean * mean, 0.0));
+		rate = (double)counters[QSPC_COUNT_COMBINATIONS] / mean;
+
+		if (threads == 1) single = rate;
+
+		printf("{\"kernel\": \"search\", \"threads\": %lld, "
+		       "\"cpus\": %lld, \"samples\": %d, "
+		       "\"combinations\": %lld, \"seconds\": %.3f, "
+		       "\"stddev_seconds\": %.3f, "
+		       "\"combinations_per_second\": %.1f, "
+		       "\"per_thread\": %.1f, \"efficiency\": %.3f}\n",
+		       (long long)threads, (long long)cpus,
+		       BENCH_SEARCH_SAMPLES,
+		       (long long)counters[QSPC_COUNT_COMBINATIONS], mean,
+		       deviation, rate, rate / (double)threads,
+		       rate / (double)threads / single);
+		fflush(stdout);
+	}
+}
+
+int main(void)
+{
+	bench_kernels();
+	bench_search();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,533 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "qspc.h"
+
+extern void QSPC_submit_result(int64_t *, int64_t *, int64_t, int64_t,
+			       int64_t);
+
+extern struct QSPC_config QSPC_config;
+
+/* Progress through the search is tracked by root, where the roots are the
+ * subtrees below QSPC_SPLIT_DEPTH, numbered in the order a single thread
+ * would search them. A root is marked finished once every combination in it
+ * has been tried. A checkpoint holds the finished roots together with the
+ * identities found in them, so a resumed run reports those identities again
+ * and then searches exactly the roots that are left. */
+
+/* An identity found in some root, kept until it is in a checkpoint. */
+struct identity_record
+{
+	int64_t root;
+	int64_t period;
+	int64_t exceptions;
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t signature[];
+};
+
+/* One bit for each root, set once the root is finished. */
+static _Atomic uint64_t *finished_roots;
+static int64_t num_roots;
+
+/* Every identity found so far, and the lock for adding to the list. */
+static struct identity_record **identities;
+static int64_t num_identities;
+static int64_t identity_capacity;
+static pthread_mutex_t identity_lock;
+
+/* The thread writing checkpoints, and how it is told to stop. */
+static pthread_t checkpoint_thread;
+static pthread_mutex_t checkpoint_lock;
+static pthread_cond_t checkpoint_cond;
+static bool checkpoint_stop;
+
+/* Returns true if a root is finished, either in this run or before it was
+ * resumed.
+ *   root: The number of the root. */
+bool QSPC_root_finished(int64_t root)
+{
+	if (finished_roots == NULL) return false;
+
+	return (atomic_load_explicit(&finished_roots[root / 64],
+				     memory_order_acquire)
+		>> (root % 64)) & 1;
+}
+
+/* Marks a root as finished. Every identity found in it must already have
+ * been recorded by QSPC_record_identity.
+ *   root: The number of the root. */
+void QSPC_finish_root(int64_t root)
+{
+	if (finished_roots == NULL) return;
+
+	atomic_fetch_or_explicit(&finished_roots[root / 64],
+				 (uint64_t)1 << (root % 64),
+				 memory_order_release);
+}
+
+/* Helper function for QSPC_record_identity and read_checkpoint. Adds an
+ * identity to the list, which the caller must hold the lock for. */
+static void add_identity(int64_t root, int64_t *parameters,
+			 int64_t *signature, int64_t period,
+			 int64_t exceptions)
+{
+	struct identity_record *record;
+	int64_t length = period + 2 * exceptions;
+
+	if (num_identities == identity_capacity) {
+		identity_capacity = 2 * identity_capacity + 16;
+		identities = realloc(identities, (size_t)identity_capacity
+				     * sizeof(struct identity_record *));
+	}
+
+	record = malloc(sizeof(struct identity_record)
+			+ (size_t)length * sizeof(int64_t));
+	record->root = root;
+	record->period = period;
+	record->exceptions = exceptions;
+
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+		record->parameters[index] = parameters[index];
+
+	for (int64_t index = 0; index < length; ++index)
+		record->signature[index] = signature[index];
+
+	identities[num_identities++] = record;
+}
+
+/* Keeps an identity for the checkpoints. Does nothing unless checkpoints
+ * are enabled.
+ *   root: The number of the root the identity was found in.
+ *   parameters: The series parameters.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions. */
+void QSPC_record_identity(int64_t root, int64_t *parameters,
+			  int64_t *signature, int64_t period,
+			  int64_t exceptions)
+{
+	if (finished_roots == NULL) return;
+
+	pthread_mutex_lock(&identity_lock);
+	add_identity(root, parameters, signature, period, exceptions);
+	pthread_mutex_unlock(&identity_lock);
+}
+
+/* The settings that change which identities are found, and so must stay
+ * the same for a run to be resumed. The thread counts and the screening do
+ * not change the results, so they are left out. */
+static const int64_t *search_settings[] = {
+	&QSPC_config.max_power_deg_1, &QSPC_config.max_power_deg_2,
+	&QSPC_config.max_fac_deg_0, &QSPC_config.max_fac_deg_1,
+	&QSPC_config.max_dil_1, &QSPC_config.max_dil_2,
+	&QSPC_config.num_qps, &QSPC_config.coefficient_bound,
+	&QSPC_config.pattern_bound, &QSPC_config.preperiod,
+	&QSPC_config.max_exceptions, &QSPC_config.verify_bound
+};
+
+#define NUM_SEARCH_SETTINGS \
+	((int64_t)(sizeof(search_settings) / sizeof(search_settings[0])))
+
+/* Writes a checkpoint to QSPC_config.checkpoint_path. It is written to a
+ * temporary file first and then renamed over the old one, so that a run
+ * killed part way through always leaves a whole checkpoint behind. Returns
+ * false on failure. */
+static bool write_checkpoint(void)
+{
+	int64_t words = (num_roots + 63) / 64;
+	uint64_t *finished = malloc((size_t)words * sizeof(uint64_t));
+	char path[strlen(QSPC_config.checkpoint_path) + 5];
+	int64_t start = -1;
+	FILE *file;
+	bool success;
+
+	/* The roots are copied before the identities are, so that every
+	 * identity of a copied root is sure to be in the list. */
+	for (int64_t index = 0; index < words; ++index) {
+		finished[index] = atomic_load_explicit(&finished_roots[index],
+						       memory_order_acquire);
+	}
+
+	sprintf(path, "%s.tmp", QSPC_config.checkpoint_path);
+	file = fopen(path, "w");
+
+	if (file == NULL) {
+		free(finished);
+		return false;
+	}
+
+	fprintf(file, "qspc-checkpoint %d\nsettings", QSPC_PARAMETER_LENGTH);
+
+	for (int64_t index = 0; index < NUM_SEARCH_SETTINGS; ++index)
+		fprintf(file, " %lld", (long long)*search_settings[index]);
+
+	fprintf(file, "\nshard %lld %lld\nroots %lld\n",
+		(long long)QSPC_config.shard_index,
+		(long long)QSPC_config.shard_count, (long long)num_roots);
+
+	/* Finished roots are written as runs of consecutive numbers. */
+	for (int64_t index = 0; index <= num_roots; ++index) {
+		bool bit = index < num_roots
+			   && ((finished[index / 64] >> (index % 64)) & 1);
+
+		if (bit && start == -1) start = index;
+
+		if (!bit && start != -1) {
+			fprintf(file, "finished %lld %lld\n", (long long)start,
+				(long long)(index - start));
+			start = -1;
+		}
+	}
+
+	pthread_mutex_lock(&identity_lock);
+
+	for (int64_t index = 0; index < num_identities; ++index) {
+		struct identity_record *record = identities[index];
+		int64_t root = record->root;
+
+		if (!((finished[root / 64] >> (root % 64)) & 1)) continue;
+
+		fprintf(file, "identity %lld %lld %lld",
+			(long long)record->root, (long long)record->period,
+			(long long)record->exceptions);
+
+		for (int64_t index2 = 0; index2 < QSPC_PARAMETER_LENGTH;
+		     ++index2) {
+			fprintf(file, " %lld",
+				(long long)record->parameters[index2]);
+		}
+
+		for (int64_t index2 = 0; index2 < record->period
+		     + 2 * record->exceptions; ++index2) {
+			fprintf(file, " %lld",
+				(long long)record->signature[index2]);
+		}
+
+		fprintf(file, "\n");
+	}
+
+	pthread_mutex_unlock(&identity_lock);
+	free(finished);
+
+	success = fflush(file) == 0 && fsync(fileno(file)) == 0;
+	success &= fclose(file) == 0;
+
+	return success && rename(path, QSPC_config.checkpoint_path) == 0;
+}
+
+/* Loads the finished roots and identities of a checkpoint, adding them to
+ * those already loaded. Returns false and prints a message if the checkpoint
+ * cannot be read or is from a different search.
+ *   path: The checkpoint file.
+ *   same_shard: Whether it also has to be for the same shard. */
+static bool read_checkpoint(const char *path, bool same_shard)
+{
+	FILE *file = fopen(path, "r");
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t signature[QSPC_MAX_SIGNATURE];
+	char keyword[32];
+	long long values[4];
+	bool success;
+
+	if (file == NULL) {
+		fprintf(stderr, "qspc: cannot open %s: %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	success = fscanf(file, "qspc-checkpoint %lld settings",
+			 &values[0]) == 1 && values[0] == QSPC_PARAMETER_LENGTH;
+
+	for (int64_t index = 0; success && index < NUM_SEARCH_SETTINGS;
+	     ++index) {
+		success = fscanf(file, "%lld", &values[0]) == 1
+			  && values[0] == *search_settings[index];
+	}
+
+	success = success && fscanf(file, " shard %lld %lld roots %lld",
+				    &values[0], &values[1], &values[2]) == 3
+		  && values[2] == num_roots;
+
+	if (success && same_shard) {
+		success = values[0] == QSPC_config.shard_index
+			  && values[1] == QSPC_config.shard_count;
+	}
+
+	if (!success) {
+		fprintf(stderr, "qspc: %s is not a checkpoint of this "
+			"search\n", path);
+		fclose(file);
+		return false;
+	}
+
+	while (success && fscanf(file, "%31s", keyword) == 1) {
+		if (strcmp(keyword, "finished") == 0) {
+			success = fscanf(file, "%lld %lld", &values[0],
+					 &values[1]) == 2 && values[0] >= 0
+				  && values[1] >= 0
+				  && values[0] + values[1] <= num_roots;
+
+			for (long long index = values[0]; success
+			     && index < values[0] + values[1]; ++index)
+				QSPC_finish_root(index);
+		} else if (strcmp(keyword, "identity") == 0) {
+			success = fscanf(file, "%lld %lld %lld", &values[0],
+					 &values[1], &values[2]) == 3
+				  && values[0] >= 0 && values[0] < num_roots
+				  && values[1] > 0
+				  && values[1] <= QSPC_config.pattern_bound
+				  && values[2] >= 0
+				  && values[2] <= QSPC_EXCEPTION_LIMIT;
+
+			for (int64_t index = 0; success
+			     && index < QSPC_PARAMETER_LENGTH; ++index) {
+				success = fscanf(file, "%lld",
+						 &values[3]) == 1;
+				parameters[index] = values[3];
+			}
+
+			for (int64_t index = 0; success && index < values[1]
+			     + 2 * values[2]; ++index) {
+				success = fscanf(file, "%lld",
+						 &values[3]) == 1;
+				signature[index] = values[3];
+			}
+
+			if (success) {
+				add_identity(values[0], parameters, signature,
+					     values[1], values[2]);
+			}
+		} else {
+			success = false;
+		}
+	}
+
+	if (!success) fprintf(stderr, "qspc: %s is corrupt\n", path);
+
+	fclose(file);
+
+	return success;
+}
+
+/* Entry point for the checkpoint thread. */
+static void *checkpoint_main(void *argument)
+{
+	struct timespec deadline;
+
+	(void)argument;
+
+	pthread_mutex_lock(&checkpoint_lock);
+
+	while (!checkpoint_stop) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += QSPC_config.checkpoint_interval;
+
+		while (!checkpoint_stop) {
+			if (pthread_cond_timedwait(&checkpoint_cond,
+						   &checkpoint_lock,
+						   &deadline) == ETIMEDOUT)
+				break;
+		}
+
+		if (checkpoint_stop) break;
+
+		/* Other threads only take the lock to stop this one. */
+		pthread_mutex_unlock(&checkpoint_lock);
+
+		if (!write_checkpoint()) {
+			fprintf(stderr, "qspc: cannot write %s\n",
+				QSPC_config.checkpoint_path);
+		}
+
+		pthread_mutex_lock(&checkpoint_lock);
+	}
+
+	pthread_mutex_unlock(&checkpoint_lock);
+
+	return NULL;
+}
+
+/* Helper function for QSPC_start_checkpoints and QSPC_merge_checkpoints.
+ * Sets up the tracking of roots and identities. */
+static void create_tracking(int64_t roots)
+{
+	num_roots = roots;
+	finished_roots = calloc((size_t)(roots + 63) / 64, sizeof(uint64_t));
+	pthread_mutex_init(&identity_lock, NULL);
+}
+
+/* Frees up the roots and identities tracked. */
+static void delete_tracking(void)
+{
+	for (int64_t index = 0; index < num_identities; ++index)
+		free(identities[index]);
+
+	free(identities);
+	free(finished_roots);
+	pthread_mutex_destroy(&identity_lock);
+}
+
+/* Starts tracking roots and writing checkpoints, if a checkpoint file was
+ * given. When resuming, the identities found before are written out again
+ * first. Returns false if the checkpoint could not be resumed.
+ *   roots: The number of roots in the search. */
+bool QSPC_start_checkpoints(int64_t roots)
+{
+	int64_t resumed = 0;
+
+	if (QSPC_config.checkpoint_path == NULL) return true;
+
+	create_tracking(roots);
+	pthread_mutex_init(&checkpoint_lock, NULL);
+	pthread_cond_init(&checkpoint_cond, NULL);
+	checkpoint_stop = false;
+
+	if (QSPC_config.resume) {
+		if (!read_checkpoint(QSPC_config.checkpoint_path, true))
+			return false;
+
+		for (int64_t index = 0; index < num_identities; ++index) {
+			QSPC_submit_result(identities[index]->parameters,
+					   identities[index]->signature,
+					   identities[index]->period,
+					   identities[index]->exceptions,
+					   QSPC_verified_bound(&QSPC_config));
+		}
+
+		for (int64_t index = 0; index < roots; ++index)
+			resumed += QSPC_root_finished(index);
+
+		fprintf(stderr, "Resumed: %lld of %lld roots already "
+			"searched\n", (long long)resumed, (long long)roots);
+	}
+
+	pthread_create(&checkpoint_thread, NULL, checkpoint_main, NULL);
+
+	return true;
+}
+
+/* Stops the checkpoint thread and writes a final checkpoint, which holds
+ * the whole search if it ran to the end. Returns false if that failed. */
+bool QSPC_stop_checkpoints(void)
+{
+	bool success;
+
+	if (QSPC_config.checkpoint_path == NULL) return true;
+
+	pthread_mutex_lock(&checkpoint_lock);
+	checkpoint_stop = true;
+	pthread_cond_signal(&checkpoint_cond);
+	pthread_mutex_unlock(&checkpoint_lock);
+	pthread_join(checkpoint_thread, NULL);
+
+	success = write_checkpoint();
+
+	if (!success) {
+		fprintf(stderr, "qspc: cannot write %s\n",
+			QSPC_config.checkpoint_path);
+	}
+
+	delete_tracking();
+	pthread_mutex_destroy(&checkpoint_lock);
+	pthread_cond_destroy(&checkpoint_cond);
+
+	return success;
+}
+
+/* Helper function for QSPC_merge_checkpoints, for use with qsort. Orders
+ * identities the way a single thread would find them: by root, and then by
+ * the leading power, with the sign and the divisor varying fastest. */
+static int compare_identities(const void *pointer1, const void *pointer2)
+{
+	const struct identity_record *record1
+		= *(const struct identity_record * const *)pointer1;
+	const struct identity_record *record2
+		= *(const struct identity_record * const *)pointer2;
+	int64_t key1[5] = {
+		record1->root,
+		record1->parameters[QSPC_PARAMETER_LENGTH - 4],
+		record1->parameters[QSPC_PARAMETER_LENGTH - 3],
+		record1->parameters[QSPC_PARAMETER_LENGTH - 2],
+		-record1->parameters[QSPC_PARAMETER_LENGTH - 1]
+	};
+	int64_t key2[5] = {
+		record2->root,
+		record2->parameters[QSPC_PARAMETER_LENGTH - 4],
+		record2->parameters[QSPC_PARAMETER_LENGTH - 3],
+		record2->parameters[QSPC_PARAMETER_LENGTH - 2],
+		-record2->parameters[QSPC_PARAMETER_LENGTH - 1]
+	};
+
+	for (int64_t index = 0; index < 5; ++index) {
+		if (key1[index] != key2[index])
+			return key1[index] < key2[index] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* Writes out every identity in the checkpoints of a sharded search, in the
+ * order a single thread would find them. This order does not depend on how
+ * the search was split up, so merging the shards gives the same output as
+ * merging the checkpoint of a run over the whole search. Returns false if
+ * a checkpoint could not be read, or if the shards do not cover the whole
+ * search, in which case the identities that were found are still
+ * written out.
+ *   roots: The number of roots in the search. */
+bool QSPC_merge_checkpoints(int64_t roots)
+{
+	int64_t finished = 0;
+	int64_t kept = 0;
+	bool success = true;
+
+	create_tracking(roots);
+
+	for (int64_t index = 0; index < QSPC_config.num_merge_paths; ++index)
+		success &= read_checkpoint(QSPC_config.merge_paths[index],
+					   false);
+
+	qsort(identities, (size_t)num_identities,
+	      sizeof(struct identity_record *), compare_identities);
+
+	/* A root in more than one checkpoint has its identities repeated. */
+	for (int64_t index = 0; index < num_identities; ++index) {
+		if (kept > 0 && compare_identities(&identities[kept - 1],
+						   &identities[index]) == 0) {
+			free(identities[index]);
+			continue;
+		}
+
+		identities[kept++] = identities[index];
+	}
+
+	num_identities = kept;
+
+	for (int64_t index = 0; index < num_identities; ++index) {
+		QSPC_submit_result(identities[index]->parameters,
+				   identities[index]->signature,
+				   identities[index]->period,
+				   identities[index]->exceptions,
+				   QSPC_verified_bound(&QSPC_config));
+	}
+
+	for (int64_t index = 0; index < roots; ++index)
+		finished += QSPC_root_finished(index);
+
+	if (finished < roots) {
+		fprintf(stderr, "qspc: the checkpoints only cover %lld of %lld "
+			"roots\n", (long long)finished, (long long)roots);
+		success = false;
+	}
+
+	delete_tracking();
+
+	return success;
+}
@@ -0,0 +1,335 @@
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qspc.h"
+
+/* The settings of the program, which start out as QSPC_default_config. */
+struct QSPC_config QSPC_config;
+
+/* Each setting that can be changed, by the name used for it both on the
+ * command line and in configuration files. */
+struct config_option
+{
+	const char *name;
+	int64_t *value;
+	int64_t minimum;
+	int64_t maximum;
+	const char *description;
+};
+
+static const struct config_option config_options[] = {
+	{"threads", &QSPC_config.num_threads, 0, 4096,
+	 "number of worker threads, or 0 for one per CPU"},
+	{"bound", &QSPC_config.coefficient_bound, 2, 1 << 20,
+	 "coefficients computed for each series"},
+	{"pattern-bound", &QSPC_config.pattern_bound, 1,
+	 QSPC_MAX_PATTERN_BOUND,
+	 "largest pattern length to look for"},
+	{"preperiod", &QSPC_config.preperiod, 0, QSPC_EXCEPTION_LIMIT,
+	 "leading powers exempt from the pattern"},
+	{"exceptions", &QSPC_config.max_exceptions, 0, QSPC_EXCEPTION_LIMIT,
+	 "other powers that may break the pattern"},
+	{"screen-bound", &QSPC_config.screen_bound, 0, 1 << 20,
+	 "coefficients to screen with, or 0 for none"},
+	{"verify-bound", &QSPC_config.verify_bound, 0, 1 << 20,
+	 "coefficients to verify identities to"},
+	{"verify-threads", &QSPC_config.verify_threads, 1, 4096,
+	 "number of threads verifying identities"},
+	{"num-qps", &QSPC_config.num_qps, 0, QSPC_MAX_NUM_QPS,
+	 "symbols in the numerator and denominator"},
+	{"power-deg-1", &QSPC_config.max_power_deg_1, 0, 1 << 10,
+	 "bound on the n coefficient of the power"},
+	{"power-deg-2", &QSPC_config.max_power_deg_2, 0, 1 << 10,
+	 "bound on the n^2 coefficient of the power"},
+	{"fac-deg-0", &QSPC_config.max_fac_deg_0, 0, 1 << 10,
+	 "largest constant term of a subscript"},
+	{"fac-deg-1", &QSPC_config.max_fac_deg_1, 0, 1 << 10,
+	 "largest n coefficient of a subscript"},
+	{"dil-1", &QSPC_config.max_dil_1, 0, 1 << 10,
+	 "largest a in a symbol (q^a; q^b)"},
+	{"dil-2", &QSPC_config.max_dil_2, 0, 1 << 10,
+	 "largest b in a symbol (q^a; q^b)"},
+	{"checkpoint-interval", &QSPC_config.checkpoint_interval, 1, 1 << 20,
+	 "seconds between checkpoints"},
+	{"progress-interval", &QSPC_config.progress_interval, 0, 1 << 20,
+	 "seconds between progress reports, 0 for none"}
+};
+
+#define NUM_CONFIG_OPTIONS \
+	((int)(sizeof(config_options) / sizeof(config_options[0])))
+
+/* Prints a summary of the command line options. */
+static void print_usage(FILE *stream, const char *program)
+{
+	fprintf(stream, "Usage: %s [OPTION]...\n", program);
+	fprintf(stream, "Searches for q-series sum-product identities, "
+		"writing them to stdout as JSON Lines.\n\n");
+	fprintf(stream, "  --config=FILE        read options from FILE, one "
+		"\"name = value\" per line\n");
+	fprintf(stream, "  --checkpoint=FILE    save progress to FILE every "
+		"so often\n");
+	fprintf(stream, "  --resume             carry on from the checkpoint "
+		"in FILE\n");
+	fprintf(stream, "  --database=FILE      reuse the regions searched in "
+		"FILE, and add this one\n");
+	fprintf(stream, "  --shard=I/N          only search shard I of N, "
+		"numbered from 0\n");
+	fprintf(stream, "  --merge FILE...      print the identities in the "
+		"checkpoints of each shard\n");
+	fprintf(stream, "  --render=FILE        print the identities in FILE, "
+		"or - for stdin, as LaTeX\n");
+	fprintf(stream, "  --cpus=LIST          pin the workers to the CPUs in "
+		"LIST, like 0-3,8, or all\n");
+
+	for (int index = 0; index < NUM_CONFIG_OPTIONS; ++index) {
+		const struct config_option *option = &config_options[index];
+
+		int padding = 17 - (int)strlen(option->name);
+
+		/* Longer names get the description on a line of its own. */
+		if (padding < 1) {
+			fprintf(stream, "  --%s=N\n", option->name);
+			padding = 23;
+		} else {
+			fprintf(stream, "  --%s=N", option->name);
+		}
+
+		fprintf(stream, "%*s%s (default %lld)\n", padding, "",
+			option->description, (long long)*option->value);
+	}
+
+	fprintf(stream, "  --help               print this message\n");
+}
+
+/* Sets a configuration option from its textual value. Returns false and
+ * prints a message if the name or the value is not valid.
+ *   name: The name of the option, without any leading dashes.
+ *   text: The value to set it to. */
+static bool set_option(const char *name, const char *text)
+{
+	for (int index = 0; index < NUM_CONFIG_OPTIONS; ++index) {
+		const struct config_option *option = &config_options[index];
+		long long value;
+		char *end;
+
+		if (strcmp(name, option->name) != 0) continue;
+
+		value = strtoll(text, &end, 10);
+
+		if (*text == '\0' || *end != '\0' || value < option->minimum
+		    || value > option->maximum) {
+			fprintf(stderr, "qspc: %s must be an integer between "
+				"%lld and %lld, not \"%s\"\n", name,
+				(long long)option->minimum,
+				(long long)option->maximum, text);
+			return false;
+		}
+
+		*option->value = value;
+
+		return true;
+	}
+
+	fprintf(stderr, "qspc: unknown option \"%s\"\n", name);
+
+	return false;
+}
+
+/* Reads options from a configuration file. Each line is either blank, a
+ * comment starting with #, or of the form "name = value". Returns false and
+ * prints a message on any error.
+ *   path: The file to read. */
+static bool read_config_file(const char *path)
+{
+	FILE *file = fopen(path, "r");
+	char line[256];
+	int64_t line_number = 0;
+	bool success = true;
+
+	if (file == NULL) {
+		fprintf(stderr, "qspc: cannot open %s\n", path);
+		return false;
+	}
+
+	while (success && fgets(line, sizeof(line), file) != NULL) {
+		char name[64];
+		char value[64];
+		char extra;
+		int fields;
+
+		++line_number;
+
+		/* Drop any comment, and skip lines left blank. */
+		line[strcspn(line, "#")] = '\0';
+		fields = sscanf(line, " %63[^= \t\n] = %63s %c", name, value,
+				&extra);
+
+		if (fields == EOF) continue;
+
+		if (fields != 2) {
+			fprintf(stderr, "qspc: %s:%lld: expected \"name = "
+				"value\"\n", path, (long long)line_number);
+			success = false;
+			break;
+		}
+
+		success = set_option(name, value);
+	}
+
+	fclose(file);
+
+	return success;
+}
+
+/* Sets the shard to search from text of the form "i/N". Returns false and
+ * prints a message if the text is not valid. */
+static bool set_shard(const char *text)
+{
+	long long index;
+	long long count;
+	int length = 0;
+
+	if (sscanf(text, "%lld/%lld%n", &index, &count, &length) != 2
+	    || text[length] != '\0' || count < 1 || index < 0
+	    || index >= count) {
+		fprintf(stderr, "qspc: shard must be of the form i/N with "
+			"0 <= i < N, not \"%s\"\n", text);
+		return false;
+	}
+
+	QSPC_config.shard_index = index;
+	QSPC_config.shard_count = count;
+
+	return true;
+}
+
+/* Fills in QSPC_config from the command line. Options are applied in order,
+ * so a --config file can be overridden by the options after it. Returns
+ * false and prints a message if the options are not valid, and exits after
+ * printing the usage for --help.
+ *   argc: The number of arguments, as passed to main.
+ *   argv: The arguments, as passed to main. */
+bool QSPC_parse_config(int argc, char **argv)
+{
+	struct option options[NUM_CONFIG_OPTIONS + 10];
+	const char *message;
+	bool merge = false;
+	int result;
+
+	QSPC_config = QSPC_default_config;
+
+	for (int index = 0; index < NUM_CONFIG_OPTIONS; ++index) {
+		options[index].name = config_options[index].name;
+		options[index].has_arg = required_argument;
+		options[index].flag = NULL;
+		options[index].val = 0;
+	}
+
+	options[NUM_CONFIG_OPTIONS] = (struct option){"config",
+		required_argument, NULL, 'c'};
+	options[NUM_CONFIG_OPTIONS + 1] = (struct option){"help",
+		no_argument, NULL, 'h'};
+	options[NUM_CONFIG_OPTIONS + 2] = (struct option){"checkpoint",
+		required_argument, NULL, 'k'};
+	options[NUM_CONFIG_OPTIONS + 3] = (struct option){"resume",
+		no_argument, NULL, 'r'};
+	options[NUM_CONFIG_OPTIONS + 4] = (struct option){"shard",
+		required_argument, NULL, 's'};
+	options[NUM_CONFIG_OPTIONS + 5] = (struct option){"merge",
+		no_argument, NULL, 'm'};
+	options[NUM_CONFIG_OPTIONS + 6] = (struct option){"render",
+		required_argument, NULL, 'l'};
+	options[NUM_CONFIG_OPTIONS + 7] = (struct option){"cpus",
+		required_argument, NULL, 'p'};
+	options[NUM_CONFIG_OPTIONS + 8] = (struct option){"database",
+		required_argument, NULL, 'd'};
+	options[NUM_CONFIG_OPTIONS + 9] = (struct option){NULL, 0, NULL, 0};
+
+	for (;;) {
+		int index = -1;
+
+		result = getopt_long(argc, argv, "c:h", options, &index);
+
+		if (result == -1) break;
+
+		switch (result) {
+		case 0:
+			if (!set_option(options[index].name, optarg))
+				return false;
+
+			break;
+		case 'c':
+			if (!read_config_file(optarg)) return false;
+
+			break;
+		case 'k':
+			QSPC_config.checkpoint_path = optarg;
+			break;
+		case 'r':
+			QSPC_config.resume = true;
+			break;
+		case 's':
+			if (!set_shard(optarg)) return false;
+
+			break;
+		case 'm':
+			merge = true;
+			break;
+		case 'l':
+			QSPC_config.render_path = optarg;
+			break;
+		case 'p':
+			QSPC_config.cpu_list = optarg;
+			break;
+		case 'd':
+			QSPC_config.database_path = optarg;
+			break;
+		case 'h':
+			print_usage(stdout, argv[0]);
+			exit(EXIT_SUCCESS);
+		default:
+			print_usage(stderr, argv[0]);
+			return false;
+		}
+	}
+
+	/* Only merging takes any arguments, which are the files to merge. */
+	if (merge) {
+		QSPC_config.num_merge_paths = argc - optind;
+		QSPC_config.merge_paths = &argv[optind];
+
+		if (argc == optind) {
+			fprintf(stderr, "qspc: --merge needs files to merge\n");
+			return false;
+		}
+	} else if (optind < argc) {
+		fprintf(stderr, "qspc: unexpected argument \"%s\"\n",
+			argv[optind]);
+		return false;
+	}
+
+	if (QSPC_config.resume && QSPC_config.checkpoint_path == NULL) {
+		fprintf(stderr, "qspc: --resume needs --checkpoint\n");
+		return false;
+	}
+
+	/* A region is only in the database once all of it is searched. */
+	if (QSPC_config.database_path != NULL
+	    && (QSPC_config.shard_count > 1 || merge)) {
+		fprintf(stderr, "qspc: --database cannot be used with --shard "
+			"or --merge\n");
+		return false;
+	}
+
+	message = QSPC_check_config(&QSPC_config);
+
+	if (message != NULL) {
+		fprintf(stderr, "qspc: %s\n", message);
+		return false;
+	}
+
+	return true;
+}
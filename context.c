@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+extern void QSPC_generate_divisors(struct QSPC_context *);
+extern void QSPC_delete_divisors(struct QSPC_context *);
+extern void QSPC_create_series_cache(struct QSPC_context *);
+extern void QSPC_delete_series_cache(struct QSPC_context *);
+extern void QSPC_create_memo(struct QSPC_context *);
+extern void QSPC_delete_memo(struct QSPC_context *);
+extern void QSPC_create_search(struct QSPC_context *);
+extern void QSPC_delete_search(struct QSPC_context *);
+extern void QSPC_create_verify(struct QSPC_context *);
+extern void QSPC_delete_verify(struct QSPC_context *);
+extern bool QSPC_cpu_list_valid(const char *);
+extern void QSPC_create_topology(struct QSPC_context *);
+extern void QSPC_delete_topology(struct QSPC_context *);
+extern void QSPC_create_regions(struct QSPC_context *);
+extern void QSPC_delete_regions(struct QSPC_context *);
+
+/* A context owns everything that used to be set up once for the whole
+ * program: the tables of divisors, the cache of series summands, the memo of
+ * factored series, the table of root counts, the verification queue, the
+ * CPUs to run on and the regions searched before. Its settings are copied
+ * in when it is made, with the number of threads filled in and the
+ * screening bound made long enough to rule anything out but kept within
+ * the coefficients, and never change after, so none of this has to be
+ * rebuilt or locked against a change of settings. */
+
+/* Turns the value of a definition into a string literal. */
+#define STRINGIFY(value) #value
+#define EXPAND_STRINGIFY(value) STRINGIFY(value)
+
+/* The settings the definitions in qspc.h give, searching the whole of a
+ * single shard. */
+const struct QSPC_config QSPC_default_config = {
+	.num_threads = QSPC_NUM_THREADS,
+	.max_power_deg_1 = QSPC_MAX_POWER_DEG_1,
+	.max_power_deg_2 = QSPC_MAX_POWER_DEG_2,
+	.max_fac_deg_0 = QSPC_MAX_FAC_DEG_0,
+	.max_fac_deg_1 = QSPC_MAX_FAC_DEG_1,
+	.max_dil_1 = QSPC_MAX_DIL_1,
+	.max_dil_2 = QSPC_MAX_DIL_2,
+	.num_qps = QSPC_NUM_QPS,
+	.coefficient_bound = QSPC_COEFFICIENT_BOUND,
+	.pattern_bound = QSPC_PATTERN_BOUND,
+	.preperiod = QSPC_PREPERIOD,
+	.max_exceptions = QSPC_MAX_EXCEPTIONS,
+	.screen_bound = QSPC_SCREEN_BOUND,
+	.verify_bound = QSPC_VERIFY_BOUND,
+	.verify_threads = QSPC_VERIFY_THREADS,
+	.cpu_list = NULL,
+	.checkpoint_interval = QSPC_CHECKPOINT_INTERVAL,
+	.progress_interval = QSPC_PROGRESS_INTERVAL,
+	.checkpoint_path = NULL,
+	.database_path = NULL,
+	.resume = false,
+	.shard_index = 0,
+	.shard_count = 1,
+	.num_merge_paths = 0,
+	.merge_paths = NULL,
+	.render_path = NULL
+};
+
+/* Checks that a context can be made with the given settings. Returns a
+ * message saying what is wrong with them, or NULL if nothing is.
+ *   config: The settings to check. */
+const char *QSPC_check_config(const struct QSPC_config *config)
+{
+	if (config->num_threads < 0 || config->verify_threads < 1)
+		return "threads must be at least 1, or 0 for one per CPU";
+
+	if (!QSPC_cpu_list_valid(config->cpu_list))
+		return "cpus must be all or a list like 0-3,8 of CPUs the "
+		       "process may run on";
+
+	if (config->coefficient_bound < 2)
+		return "bound must be at least 2";
+
+	if (config->pattern_bound < 1
+	    || config->pattern_bound > QSPC_MAX_PATTERN_BOUND)
+		return "pattern-bound is out of range";
+
+	if (config->num_qps < 0 || config->num_qps > QSPC_MAX_NUM_QPS)
+		return "num-qps is out of range";
+
+	if (config->max_power_deg_1 < 0 || config->max_power_deg_2 < 0
+	    || config->max_fac_deg_0 < 0 || config->max_fac_deg_1 < 0
+	    || config->max_dil_1 < 0 || config->max_dil_2 < 0
+	    || config->screen_bound < 0 || config->verify_bound < 0)
+		return "search bounds must not be negative";
+
+	if (config->shard_count < 1 || config->shard_index < 0
+	    || config->shard_index >= config->shard_count)
+		return "shard must be of the form i/N with 0 <= i < N";
+
+	/* The pattern has to repeat within the coefficients to be found. */
+	if (config->pattern_bound >= config->coefficient_bound)
+		return "pattern-bound must be less than bound";
+
+	/* So does the pattern after the powers exempt from it. */
+	if (config->preperiod + config->pattern_bound
+	    >= config->coefficient_bound)
+		return "preperiod plus pattern-bound must be less than bound";
+
+	if (config->preperiod < 0 || config->max_exceptions < 0
+	    || config->preperiod + config->max_exceptions
+	    > QSPC_EXCEPTION_LIMIT)
+		return "preperiod and exceptions must add up to at most "
+		       EXPAND_STRINGIFY(QSPC_EXCEPTION_LIMIT);
+
+	return NULL;
+}
+
+/* Makes a context with a copy of the given settings. Returns NULL if
+ * QSPC_check_config finds anything wrong with them.
+ *   config: The settings of the context. */
+struct QSPC_context *QSPC_create_context(const struct QSPC_config *config)
+{
+	int64_t exempt = config->preperiod + config->pattern_bound
+			 + config->max_exceptions;
+	struct QSPC_context *context;
+
+	if (QSPC_check_config(config) != NULL) return NULL;
+
+	context = malloc(sizeof(struct QSPC_context));
+	context->config = *config;
+
+	/* Screening up to the preperiod, the longest pattern and one more
+	 * coefficient for each exception cannot rule anything out, so such a
+	 * bound is raised to give each exception two, and four more past the
+	 * pattern as with the default settings. */
+	if (config->screen_bound > 0 && config->screen_bound <= exempt + 1) {
+		context->config.screen_bound = exempt
+					       + config->max_exceptions + 4;
+	}
+
+	/* The tables are only built up to the coefficient bound, and there is
+	 * nothing to screen past it anyway. */
+	if (context->config.screen_bound > config->coefficient_bound)
+		context->config.screen_bound = config->coefficient_bound;
+
+	/* This settles the number of workers, which the rest depends on. */
+	QSPC_create_topology(context);
+	QSPC_generate_divisors(context);
+	QSPC_create_series_cache(context);
+	QSPC_create_memo(context);
+	QSPC_create_search(context);
+	QSPC_create_verify(context);
+	QSPC_create_regions(context);
+
+	return context;
+}
+
+/* Frees up a context, which must have no search running on it. */
+void QSPC_delete_context(struct QSPC_context *context)
+{
+	QSPC_delete_regions(context);
+	QSPC_delete_verify(context);
+	QSPC_delete_search(context);
+	QSPC_delete_memo(context);
+	QSPC_delete_series_cache(context);
+	QSPC_delete_divisors(context);
+	QSPC_delete_topology(context);
+	free(context);
+}
@@ -0,0 +1,377 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "qspc.h"
+
+extern void QSPC_submit_result(int64_t *, int64_t *, int64_t, int64_t,
+			       int64_t);
+
+extern struct QSPC_config QSPC_config;
+
+/* The run database keeps every region of the search done so far, as the
+ * ranges of the settings it was searched with, together with the
+ * identities found in it. A run over wider ranges writes out the identities
+ * of the regions inside its own right away and only searches the rest. Once
+ * it is over, its own region replaces every region inside it, so the
+ * database only grows with the regions that are not nested.
+ *
+ * Regions are only reused by runs with the same bounds on the coefficients
+ * and the patterns, since those change which identities are found. */
+
+/* An identity kept in the database. */
+struct stored_identity
+{
+	int64_t period;
+	int64_t exceptions;
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t signature[QSPC_MAX_SIGNATURE];
+};
+
+/* A region and the identities found in it. */
+struct stored_region
+{
+	struct QSPC_config settings;
+	struct stored_identity *identities;
+	int64_t num_identities;
+	int64_t capacity;
+};
+
+/* The settings a region is written with. The first five have to match for
+ * it to be reused, and the rest are the ranges it covers. */
+static const size_t region_settings[] = {
+	offsetof(struct QSPC_config, coefficient_bound),
+	offsetof(struct QSPC_config, pattern_bound),
+	offsetof(struct QSPC_config, preperiod),
+	offsetof(struct QSPC_config, max_exceptions),
+	offsetof(struct QSPC_config, verify_bound),
+	offsetof(struct QSPC_config, num_qps),
+	offsetof(struct QSPC_config, max_power_deg_1),
+	offsetof(struct QSPC_config, max_power_deg_2),
+	offsetof(struct QSPC_config, max_fac_deg_0),
+	offsetof(struct QSPC_config, max_fac_deg_1),
+	offsetof(struct QSPC_config, max_dil_1),
+	offsetof(struct QSPC_config, max_dil_2)
+};
+
+#define NUM_REGION_SETTINGS \
+	((int64_t)(sizeof(region_settings) / sizeof(region_settings[0])))
+#define NUM_BOUND_SETTINGS 5
+
+/* Returns one of the settings of a region, as listed above. */
+#define REGION_SETTING(config, index) \
+	(*(int64_t *)((char *)(config) + region_settings[index]))
+
+/* The regions read from the database, and the region of this run, which
+ * gets every identity written out. */
+static struct stored_region *stored_regions;
+static int64_t num_stored_regions;
+static struct stored_region run_region;
+static pthread_mutex_t database_lock;
+static bool database_open;
+
+/* Helper function for read_database and QSPC_keep_identity. Adds an
+ * identity to a region. */
+static void add_identity(struct stored_region *region, int64_t *parameters,
+			 int64_t *signature, int64_t period,
+			 int64_t exceptions)
+{
+	struct stored_identity *identity;
+
+	if (region->num_identities == region->capacity) {
+		region->capacity = 2 * region->capacity + 16;
+		region->identities = realloc(region->identities,
+					     (size_t)region->capacity
+					     * sizeof(struct stored_identity));
+	}
+
+	identity = &region->identities[region->num_identities++];
+	identity->period = period;
+	identity->exceptions = exceptions;
+
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+		identity->parameters[index] = parameters[index];
+
+	for (int64_t index = 0; index < period + 2 * exceptions; ++index)
+		identity->signature[index] = signature[index];
+}
+
+/* Loads the regions of the database at QSPC_config.database_path. A
+ * database that does not exist yet has no regions. Returns false and prints
+ * a message if it cannot be read. */
+static bool read_database(void)
+{
+	const char *path = QSPC_config.database_path;
+	FILE *file = fopen(path, "r");
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t signature[QSPC_MAX_SIGNATURE];
+	struct stored_region *region = NULL;
+	char keyword[32];
+	long long values[3];
+	bool success;
+
+	if (file == NULL && errno == ENOENT) return true;
+
+	if (file == NULL) {
+		fprintf(stderr, "qspc: cannot open %s: %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	success = fscanf(file, "qspc-database %lld", &values[0]) == 1
+		  && values[0] == QSPC_PARAMETER_LENGTH;
+
+	if (!success) {
+		fprintf(stderr, "qspc: %s is not a run database\n", path);
+		fclose(file);
+		return false;
+	}
+
+	while (success && fscanf(file, "%31s", keyword) == 1) {
+		if (strcmp(keyword, "region") == 0) {
+			size_t size = (size_t)(num_stored_regions + 1)
+				      * sizeof(struct stored_region);
+
+			stored_regions = realloc(stored_regions, size);
+			region = &stored_regions[num_stored_regions++];
+			*region = (struct stored_region){
+				.settings = QSPC_default_config
+			};
+
+			for (int64_t index = 0; success
+			     && index < NUM_REGION_SETTINGS; ++index) {
+				success = fscanf(file, "%lld",
+						 &values[0]) == 1
+					  && values[0] >= 0;
+				REGION_SETTING(&region->settings, index)
+					= values[0];
+			}
+		} else if (strcmp(keyword, "identity") == 0) {
+			success = region != NULL
+				  && fscanf(file, "%lld %lld", &values[0],
+					    &values[1]) == 2
+				  && values[0] > 0
+				  && values[0] <= QSPC_MAX_PATTERN_BOUND
+				  && values[1] >= 0
+				  && values[1] <= QSPC_EXCEPTION_LIMIT;
+
+			for (int64_t index = 0; success
+			     && index < QSPC_PARAMETER_LENGTH; ++index) {
+				success = fscanf(file, "%lld",
+						 &values[2]) == 1;
+				parameters[index] = values[2];
+			}
+
+			for (int64_t index = 0; success && index < values[0]
+			     + 2 * values[1]; ++index) {
+				success = fscanf(file, "%lld",
+						 &values[2]) == 1;
+				signature[index] = values[2];
+			}
+
+			if (success) {
+				add_identity(region, parameters, signature,
+					     values[0], values[1]);
+			}
+		} else {
+			success = false;
+		}
+	}
+
+	if (!success) fprintf(stderr, "qspc: %s is corrupt\n", path);
+
+	fclose(file);
+
+	return success;
+}
+
+/* Helper function for write_database. Returns true if a region is inside
+ * the region of this run, which then has all of its identities. */
+static bool region_nested(struct stored_region *region)
+{
+	for (int64_t index = 0; index < NUM_REGION_SETTINGS; ++index) {
+		int64_t value = REGION_SETTING(&region->settings, index);
+		int64_t bound = REGION_SETTING(&run_region.settings, index);
+
+		if (index < NUM_BOUND_SETTINGS ? value != bound
+		    : value > bound) return false;
+	}
+
+	return true;
+}
+
+/* Helper function for write_database. Writes out a region with its
+ * identities. */
+static void write_region(FILE *file, struct stored_region *region)
+{
+	fprintf(file, "region");
+
+	for (int64_t index = 0; index < NUM_REGION_SETTINGS; ++index) {
+		fprintf(file, " %lld",
+			(long long)REGION_SETTING(&region->settings, index));
+	}
+
+	fprintf(file, "\n");
+
+	for (int64_t index1 = 0; index1 < region->num_identities; ++index1) {
+		struct stored_identity *identity
+			= &region->identities[index1];
+
+		fprintf(file, "identity %lld %lld",
+			(long long)identity->period,
+			(long long)identity->exceptions);
+
+		for (int64_t index2 = 0; index2 < QSPC_PARAMETER_LENGTH;
+		     ++index2) {
+			fprintf(file, " %lld",
+				(long long)identity->parameters[index2]);
+		}
+
+		for (int64_t index2 = 0; index2 < identity->period
+		     + 2 * identity->exceptions; ++index2) {
+			fprintf(file, " %lld",
+				(long long)identity->signature[index2]);
+		}
+
+		fprintf(file, "\n");
+	}
+}
+
+/* Writes the database back with the region of this run in place of those
+ * inside it. Like a checkpoint, it goes to a temporary file first that is
+ * then renamed over the old one. Returns false on failure. */
+static bool write_database(void)
+{
+	char path[strlen(QSPC_config.database_path) + 5];
+	FILE *file;
+	bool success;
+
+	sprintf(path, "%s.tmp", QSPC_config.database_path);
+	file = fopen(path, "w");
+
+	if (file == NULL) return false;
+
+	fprintf(file, "qspc-database %d\n", QSPC_PARAMETER_LENGTH);
+
+	for (int64_t index = 0; index < num_stored_regions; ++index) {
+		if (!region_nested(&stored_regions[index]))
+			write_region(file, &stored_regions[index]);
+	}
+
+	write_region(file, &run_region);
+
+	success = fflush(file) == 0 && fsync(fileno(file)) == 0;
+	success &= fclose(file) == 0;
+
+	return success && rename(path, QSPC_config.database_path) == 0;
+}
+
+/* Helper function for QSPC_open_database. Returns true if an identity with
+ * the given parameters was already written out in this run. */
+static bool identity_written(int64_t *parameters)
+{
+	for (int64_t index = 0; index < run_region.num_identities; ++index) {
+		if (memcmp(run_region.identities[index].parameters, parameters,
+			   sizeof(run_region.identities[index].parameters))
+		    == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* Keeps an identity written out for the region of this run. Does nothing
+ * unless a database was given.
+ *   parameters: The series parameters.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions. */
+void QSPC_keep_identity(int64_t *parameters, int64_t *signature,
+			int64_t period, int64_t exceptions)
+{
+	if (!database_open) return;
+
+	pthread_mutex_lock(&database_lock);
+	add_identity(&run_region, parameters, signature, period, exceptions);
+	pthread_mutex_unlock(&database_lock);
+}
+
+/* Reads the run database, if one was given, and tells a context about the
+ * regions in it that can be reused. The identities of these regions that
+ * are also in this run are written out again right away, and the rest of
+ * the combinations in the regions are skipped by the search. Must be called
+ * once the results are started. Returns false if the database cannot be
+ * read.
+ *   context: The context of the search. */
+bool QSPC_open_database(struct QSPC_context *context)
+{
+	if (QSPC_config.database_path == NULL) return true;
+
+	pthread_mutex_init(&database_lock, NULL);
+	run_region.settings = QSPC_config;
+	database_open = true;
+
+	if (!read_database()) return false;
+
+	for (int64_t index1 = 0; index1 < num_stored_regions; ++index1) {
+		struct stored_region *region = &stored_regions[index1];
+
+		if (!QSPC_add_searched_region(context, &region->settings))
+			continue;
+
+		/* Regions overlap, and each identity is only written out
+		 * once. */
+		for (int64_t index2 = 0; index2 < region->num_identities;
+		     ++index2) {
+			struct stored_identity *identity
+				= &region->identities[index2];
+
+			if (!QSPC_in_region(&QSPC_config,
+					    identity->parameters)
+			    || identity_written(identity->parameters))
+				continue;
+
+			QSPC_submit_result(identity->parameters,
+					   identity->signature,
+					   identity->period,
+					   identity->exceptions,
+					   QSPC_verified_bound(&QSPC_config));
+		}
+	}
+
+	return true;
+}
+
+/* Frees up the database, if one was given, first writing the region of
+ * this run to it. Returns false and prints a message if it cannot be
+ * written.
+ *   save: Whether the whole run was searched, so that it can be written. */
+bool QSPC_close_database(bool save)
+{
+	bool success = true;
+
+	if (!database_open) return true;
+
+	if (save) success = write_database();
+
+	if (!success) {
+		fprintf(stderr, "qspc: cannot write %s\n",
+			QSPC_config.database_path);
+	}
+
+	for (int64_t index = 0; index < num_stored_regions; ++index)
+		free(stored_regions[index].identities);
+
+	free(stored_regions);
+	free(run_region.identities);
+	pthread_mutex_destroy(&database_lock);
+	database_open = false;
+
+	return success;
+}
@@ -0,0 +1,139 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+/* Many of the identities found share their product side, differing only in
+ * the sum, like the variants in the sign and the divisor of the power. These
+ * are equivalent, so each identity is put in a group with the others with
+ * the same product, and only the first of each group is written out in
+ * full.
+ *
+ * A matching pattern fixes every power in the product form, and so every
+ * coefficient of the series within the bound, which makes a hash of the
+ * signature a fingerprint of the series itself. This means identities read
+ * back from checkpoints are grouped the same way as new ones. */
+
+/* A slot of the table, holding the product side of a group, or no
+ * signature if it is empty. */
+struct group_slot
+{
+	uint64_t fingerprint;
+	int64_t group;
+	int64_t period;
+	int64_t exceptions;
+	int64_t *signature;
+};
+
+/* The table is open addressed, and only used by the thread that writes out
+ * identities, which puts each in its group in the order they are written,
+ * so it needs no locks. */
+static struct group_slot group_table[QSPC_GROUP_TABLE_SIZE];
+static int64_t num_groups;
+static int64_t num_grouped;
+
+/* Helper function for QSPC_find_group. Hashes the pattern of powers.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions. */
+static uint64_t group_fingerprint(int64_t *signature, int64_t period,
+				  int64_t exceptions)
+{
+	uint64_t hash = 14695981039346656037u;
+
+	hash ^= (uint64_t)period;
+	hash *= 1099511628211u;
+	hash ^= (uint64_t)exceptions;
+	hash *= 1099511628211u;
+
+	for (int64_t index = 0; index < period + 2 * exceptions; ++index) {
+		hash ^= (uint64_t)signature[index];
+		hash *= 1099511628211u;
+	}
+
+	return hash;
+}
+
+/* Helper function for QSPC_find_group. Checks if a filled slot holds the
+ * given product side. */
+static bool group_matches(struct group_slot *slot, uint64_t fingerprint,
+			  int64_t *signature, int64_t period,
+			  int64_t exceptions)
+{
+	if (slot->fingerprint != fingerprint || slot->period != period
+	    || slot->exceptions != exceptions)
+		return false;
+
+	for (int64_t index = 0; index < period + 2 * exceptions; ++index) {
+		if (slot->signature[index] != signature[index]) return false;
+	}
+
+	return true;
+}
+
+/* Finds the group of identities with the given product side, starting a new
+ * one if there is none. Returns the number of the group, which counts up
+ * from 0 in the order groups are started.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions.
+ *   first: Set to whether the identity starts a new group. */
+int64_t QSPC_find_group(int64_t *signature, int64_t period,
+			int64_t exceptions, bool *first)
+{
+	uint64_t fingerprint = group_fingerprint(signature, period,
+						 exceptions);
+	int64_t length = period + 2 * exceptions;
+
+	++num_grouped;
+
+	for (int64_t probe = 0; probe < QSPC_GROUP_TABLE_SIZE; ++probe) {
+		struct group_slot *slot = &group_table[(fingerprint + probe)
+			& (QSPC_GROUP_TABLE_SIZE - 1)];
+
+		if (slot->signature == NULL) {
+			slot->fingerprint = fingerprint;
+			slot->period = period;
+			slot->exceptions = exceptions;
+			slot->signature = malloc((size_t)length
+						 * sizeof(int64_t));
+
+			for (int64_t index = 0; index < length; ++index)
+				slot->signature[index] = signature[index];
+
+			slot->group = num_groups++;
+			*first = true;
+
+			return slot->group;
+		}
+
+		if (group_matches(slot, fingerprint, signature, period,
+				  exceptions)) {
+			*first = false;
+			return slot->group;
+		}
+	}
+
+	/* With the table full, the identity is left in a group of its own. */
+	*first = true;
+
+	return num_groups++;
+}
+
+/* Frees up the product sides kept for each group. */
+void QSPC_delete_groups(void)
+{
+	for (int64_t index = 0; index < QSPC_GROUP_TABLE_SIZE; ++index)
+		free(group_table[index].signature);
+}
+
+/* Gets statistics on the grouping of identities.
+ *   identities: Set to the number of identities grouped.
+ *   groups: Set to the number of distinct groups among them. */
+void QSPC_group_stats(int64_t *identities, int64_t *groups)
+{
+	*identities = num_grouped;
+	*groups = num_groups;
+}
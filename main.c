@@ -0,0 +1,160 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+extern bool QSPC_parse_config(int, char **);
+extern void QSPC_report_counters(int64_t *);
+extern void QSPC_start_results(FILE *);
+extern void QSPC_stop_results(void);
+extern void QSPC_submit_result(int64_t *, int64_t *, int64_t, int64_t,
+			       int64_t);
+extern bool QSPC_render_results(const char *);
+extern void QSPC_delete_groups(void);
+extern void QSPC_group_stats(int64_t *, int64_t *);
+extern bool QSPC_start_checkpoints(int64_t);
+extern bool QSPC_stop_checkpoints(void);
+extern bool QSPC_merge_checkpoints(int64_t);
+extern bool QSPC_root_finished(int64_t);
+extern void QSPC_finish_root(int64_t);
+extern void QSPC_record_identity(int64_t, int64_t *, int64_t *, int64_t,
+				 int64_t);
+extern void QSPC_start_progress(struct QSPC_context *);
+extern void QSPC_stop_progress(void);
+extern bool QSPC_open_database(struct QSPC_context *);
+extern bool QSPC_close_database(bool);
+
+extern struct QSPC_config QSPC_config;
+
+/* The hooks of the search, which write out each identity and keep the
+ * checkpoints and the progress reports up to date. The data passed to them
+ * is the context being searched. */
+static void found_identity(void *data, int64_t root, int64_t *parameters,
+			   int64_t *signature, int64_t period,
+			   int64_t exceptions, int64_t verified)
+{
+	(void)data;
+
+	QSPC_submit_result(parameters, signature, period, exceptions,
+			   verified);
+	QSPC_record_identity(root, parameters, signature, period, exceptions);
+}
+
+static bool root_finished(void *data, int64_t root)
+{
+	(void)data;
+
+	return QSPC_root_finished(root);
+}
+
+static void finish_root(void *data, int64_t root)
+{
+	(void)data;
+
+	QSPC_finish_root(root);
+}
+
+static void start_search(void *data)
+{
+	QSPC_start_progress(data);
+}
+
+static void stop_search(void *data)
+{
+	(void)data;
+
+	QSPC_stop_progress();
+}
+
+int main(int argc, char **argv)
+{
+	struct QSPC_context *context;
+	struct QSPC_search_hooks hooks;
+	int64_t cache_hits;
+	int64_t cache_misses;
+	int64_t wide;
+	int64_t modular;
+	int64_t failed;
+	int64_t mismatched;
+	int64_t identities;
+	int64_t groups;
+	int64_t counters[QSPC_NUM_COUNTERS];
+	int64_t roots;
+	bool success;
+
+	if (!QSPC_parse_config(argc, argv)) return EXIT_FAILURE;
+
+	/* Rendering turns the output of a search into LaTeX. */
+	if (QSPC_config.render_path != NULL) {
+		return QSPC_render_results(QSPC_config.render_path)
+		       ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	/* The settings were already checked, so this cannot fail. */
+	context = QSPC_create_context(&QSPC_config);
+	roots = QSPC_count_roots(context);
+
+	/* Merging only writes out what the shards found. */
+	if (QSPC_config.num_merge_paths > 0) {
+		QSPC_start_results(stdout);
+		success = QSPC_merge_checkpoints(roots);
+		QSPC_stop_results();
+		QSPC_delete_groups();
+		QSPC_delete_context(context);
+
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	/* Resuming writes out the identities found before right away. */
+	QSPC_start_results(stdout);
+
+	if (!QSPC_start_checkpoints(roots)) {
+		QSPC_stop_results();
+		QSPC_delete_context(context);
+		return EXIT_FAILURE;
+	}
+
+	/* So does reusing what earlier runs searched. */
+	if (!QSPC_open_database(context)) {
+		QSPC_close_database(false);
+		QSPC_stop_checkpoints();
+		QSPC_stop_results();
+		QSPC_delete_groups();
+		QSPC_delete_context(context);
+		return EXIT_FAILURE;
+	}
+
+	hooks = (struct QSPC_search_hooks){
+		.data = context,
+		.identity = found_identity,
+		.root_finished = root_finished,
+		.finish_root = finish_root,
+		.start = start_search,
+		.stop = stop_search
+	};
+	QSPC_run_search(context, &hooks, counters);
+
+	success = QSPC_stop_checkpoints();
+	QSPC_stop_results();
+	success &= QSPC_close_database(true);
+
+	/* Kept off stdout, which only holds the identities. */
+	QSPC_report_counters(counters);
+	QSPC_series_cache_stats(context, &cache_hits, &cache_misses);
+	fprintf(stderr, "Series cache: %lld hits, %lld misses\n",
+		(long long)cache_hits, (long long)cache_misses);
+	QSPC_arithmetic_stats(context, &wide, &modular, &failed, &mismatched);
+	fprintf(stderr, "Overflows: %lld to __int128, %lld to modular, "
+		"%lld unresolved (%lld failing the check prime)\n",
+		(long long)wide, (long long)modular, (long long)failed,
+		(long long)mismatched);
+	QSPC_group_stats(&identities, &groups);
+	fprintf(stderr, "Identities: %lld found, %lld distinct\n",
+		(long long)identities, (long long)groups);
+
+	QSPC_delete_context(context);
+	QSPC_delete_groups();
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
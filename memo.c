@@ -0,0 +1,195 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+/* Many combinations give exactly the same series, such as those differing
+ * only in a symbol that is 1 for every summand within the bound. Factoring
+ * and looking for a pattern only depend on the series, so their outcome is
+ * kept here, keyed by a 128-bit hash of the coefficients. The hash is
+ * trusted to tell series apart, which at this width it does for any number
+ * of series a search could find.
+ *
+ * The memo is split into shards, each with its own lock, so that threads
+ * rarely wait on each other. Within a shard an entry is picked by the hash,
+ * and a new outcome replaces whatever the entry held before. */
+
+/* The outcome for one series. */
+struct memo_entry
+{
+	uint64_t key[2];
+	int64_t period;
+	int64_t exceptions;
+	bool valid;
+};
+
+struct memo_shard
+{
+	/* Kept apart, since every thread takes these locks. */
+	_Alignas(64) pthread_mutex_t lock;
+	struct memo_entry entries[QSPC_MEMO_SIZE / QSPC_MEMO_SHARDS];
+
+	/* The stride of the memo in values for each entry, of which the
+	 * first period are the pattern, followed by its exceptions. */
+	int64_t *patterns;
+};
+
+struct QSPC_memo
+{
+	struct memo_shard shards[QSPC_MEMO_SHARDS];
+
+	/* The longest signature a search can find, given the pattern bound
+	 * and the exceptions allowed. */
+	int64_t stride;
+};
+
+/* Helper function for QSPC_memo_key. Mixes the bits of a value, as in the
+ * finalizer of SplitMix64. */
+static inline uint64_t mix_bits(uint64_t value)
+{
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111eb;
+
+	return value ^ (value >> 31);
+}
+
+/* Hashes the coefficients of a series, as a key for the memo.
+ *   series: The coefficients of the series.
+ *   bound: The length of this array.
+ *   key: Where the two halves of the hash are written. */
+void QSPC_memo_key(int64_t *series, int64_t bound, uint64_t *key)
+{
+	uint64_t hash1 = 0x243f6a8885a308d3;
+	uint64_t hash2 = 0x13198a2e03707344;
+
+	/* The two halves go through each coefficient differently, so that
+	 * they are independent of each other. */
+	for (int64_t index = 0; index < bound; ++index) {
+		hash1 = mix_bits(hash1 ^ (uint64_t)series[index]);
+		hash2 = mix_bits(hash2 + (uint64_t)series[index]
+				 + 0x9e3779b97f4a7c15 * (uint64_t)index);
+	}
+
+	key[0] = hash1;
+	key[1] = hash2;
+}
+
+/* Helper function for QSPC_memo_find and QSPC_memo_store. Picks the shard
+ * for a key, and the index of its entry there. */
+static struct memo_shard *find_shard(struct QSPC_memo *memo, uint64_t *key,
+				     int64_t *index)
+{
+	*index = (int64_t)(key[1] % (QSPC_MEMO_SIZE / QSPC_MEMO_SHARDS));
+
+	return &memo->shards[key[0] % QSPC_MEMO_SHARDS];
+}
+
+/* Looks up the outcome for a series seen before. Returns false if there is
+ * none.
+ *   context: The context of the search.
+ *   key: The hash of the series, from QSPC_memo_key.
+ *   period: Set to the length of the pattern, 0 if there was none, or -1
+ *     if the powers could not be found exactly.
+ *   pattern: Where the pattern is written, if there is one, followed by
+ *     its exceptions.
+ *   exceptions: Set to the number of exceptions to the pattern. */
+bool QSPC_memo_find(struct QSPC_context *context, uint64_t *key,
+		    int64_t *period, int64_t *pattern, int64_t *exceptions)
+{
+	struct QSPC_memo *memo = context->memo;
+	int64_t index;
+	struct memo_shard *shard = find_shard(memo, key, &index);
+	struct memo_entry *entry = &shard->entries[index];
+	bool found;
+
+	pthread_mutex_lock(&shard->lock);
+	found = entry->valid && entry->key[0] == key[0]
+		&& entry->key[1] == key[1];
+
+	if (found) {
+		*period = entry->period;
+		*exceptions = entry->exceptions;
+
+		for (int64_t offset = 0; offset < entry->period
+		     + 2 * entry->exceptions; ++offset)
+			pattern[offset] = shard->patterns[index * memo->stride
+							  + offset];
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+
+	return found;
+}
+
+/* Keeps the outcome for a series.
+ *   context: The context of the search.
+ *   key: The hash of the series, from QSPC_memo_key.
+ *   period: The length of the pattern, 0 if there is none, or -1 if the
+ *     powers could not be found exactly.
+ *   pattern: The pattern, if there is one, followed by its exceptions.
+ *   exceptions: The number of exceptions to the pattern. */
+void QSPC_memo_store(struct QSPC_context *context, uint64_t *key,
+		     int64_t period, int64_t *pattern, int64_t exceptions)
+{
+	struct QSPC_memo *memo = context->memo;
+	int64_t index;
+	struct memo_shard *shard = find_shard(memo, key, &index);
+	struct memo_entry *entry = &shard->entries[index];
+
+	pthread_mutex_lock(&shard->lock);
+	entry->key[0] = key[0];
+	entry->key[1] = key[1];
+	entry->period = period;
+	entry->exceptions = exceptions;
+	entry->valid = true;
+
+	for (int64_t offset = 0; offset < period + 2 * exceptions; ++offset)
+		shard->patterns[index * memo->stride + offset]
+			= pattern[offset];
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+/* Sets up the memo of a context, empty. Called when the context is
+ * created. */
+void QSPC_create_memo(struct QSPC_context *context)
+{
+	struct QSPC_memo *memo = aligned_alloc(_Alignof(struct QSPC_memo),
+					       sizeof(struct QSPC_memo));
+
+	memo->stride = context->config.pattern_bound
+		       + 2 * (context->config.preperiod
+			      + context->config.max_exceptions);
+
+	for (int64_t index = 0; index < QSPC_MEMO_SHARDS; ++index) {
+		struct memo_shard *shard = &memo->shards[index];
+
+		pthread_mutex_init(&shard->lock, NULL);
+		shard->patterns = malloc((size_t)(QSPC_MEMO_SIZE
+						  / QSPC_MEMO_SHARDS)
+					 * (size_t)memo->stride
+					 * sizeof(int64_t));
+
+		for (int64_t entry = 0; entry < QSPC_MEMO_SIZE
+		     / QSPC_MEMO_SHARDS; ++entry)
+			shard->entries[entry].valid = false;
+	}
+
+	context->memo = memo;
+}
+
+/* Frees up the memo of a context. */
+void QSPC_delete_memo(struct QSPC_context *context)
+{
+	struct QSPC_memo *memo = context->memo;
+
+	for (int64_t index = 0; index < QSPC_MEMO_SHARDS; ++index) {
+		pthread_mutex_destroy(&memo->shards[index].lock);
+		free(memo->shards[index].patterns);
+	}
+
+	free(memo);
+}
@@ -0,0 +1,687 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "qspc.h"
+
+extern int64_t QSPC_arena_mark(void);
+extern void *QSPC_arena_alloc(int64_t);
+extern void QSPC_arena_release(int64_t);
+
+/* Primes of the form $c 2^k + 1$ used for modular arithmetic. They are all
+ * below 2^30, so that the product of two residues fits in int64_t, and
+ * each has 3 as a primitive root. */
+const int64_t QSPC_primes[QSPC_NUM_PRIMES] = {
+	998244353, 1004535809, 469762049
+};
+
+/* Returns the product of two residues modulo a prime. */
+static inline int64_t multiply_mod(int64_t value1, int64_t value2,
+				   int64_t prime)
+{
+	return value1 * value2 % prime;
+}
+
+/* Returns value raised to the given exponent modulo a prime. */
+static int64_t power_mod(int64_t value, int64_t exponent, int64_t prime)
+{
+	int64_t result = 1;
+
+	value %= prime;
+
+	for (; exponent > 0; exponent /= 2) {
+		if (exponent % 2 == 1)
+			result = multiply_mod(result, value, prime);
+
+		value = multiply_mod(value, value, prime);
+	}
+
+	return result;
+}
+
+/* Multiplies a truncated series of residues in place by $1 - s q^k$.
+ *   power: The value k, which must be at least 1.
+ *   sign: The value s, which is 1 or -1.
+ *   series: The residues of the series, which are overwritten.
+ *   bound: The length of this array.
+ *   prime: The modulus. */
+static void multiply_binomial(int64_t power, int64_t sign, int64_t *series,
+			      int64_t bound, int64_t prime)
+{
+	for (int64_t index = bound - 1; index >= power; --index) {
+		if (sign == 1) {
+			series[index] -= series[index - power];
+
+			if (series[index] < 0) series[index] += prime;
+		} else {
+			series[index] += series[index - power];
+
+			if (series[index] >= prime) series[index] -= prime;
+		}
+	}
+}
+
+/* Divides a truncated series of residues in place by $1 - s q^k$. The
+ * parameters are the same as for multiply_binomial. */
+static void divide_binomial(int64_t power, int64_t sign, int64_t *series,
+			    int64_t bound, int64_t prime)
+{
+	for (int64_t index = power; index < bound; ++index) {
+		if (sign == 1) {
+			series[index] += series[index - power];
+
+			if (series[index] >= prime) series[index] -= prime;
+		} else {
+			series[index] -= series[index - power];
+
+			if (series[index] < 0) series[index] += prime;
+		}
+	}
+}
+
+/* Helper function for QSPC_build_series_mod. Works the same way as
+ * extend_series_term in algebra.c. */
+static void extend_series_term(int64_t *parameters, int64_t *factors,
+			       int64_t *term, int64_t bound,
+			       int64_t summation_index, int64_t prime)
+{
+	for (int64_t index1 = 0; index1 < 2 * QSPC_MAX_NUM_QPS; ++index1) {
+		int64_t *symbol = &parameters[4 * index1];
+		int64_t target = symbol[0] * summation_index + symbol[1];
+
+		/* Skip to the denominator on the first empty symbol. */
+		if (symbol[0] == 0) {
+			if (index1 >= QSPC_MAX_NUM_QPS) break;
+
+			index1 = QSPC_MAX_NUM_QPS - 1;
+			continue;
+		}
+
+		for (; factors[index1] < target; ++factors[index1]) {
+			int64_t power = symbol[2] + symbol[3]
+				      * factors[index1];
+
+			if (power >= bound) continue;
+
+			if (index1 < QSPC_MAX_NUM_QPS) {
+				multiply_binomial(power, -1, term, bound,
+						  prime);
+			} else {
+				divide_binomial(power, 1, term, bound, prime);
+			}
+		}
+	}
+}
+
+/* Computes the residues of the truncated coefficients of a q-series modulo
+ * a prime. This cannot overflow, whatever the bound.
+ *   parameters: The parameters that encode the series.
+ *   result: The array the residues are written to, each between 0 and one
+ *     less than the prime.
+ *   bound: The length of this array, and the number of coefficients found.
+ *   prime: The modulus, which must be below 2^62. */
+void QSPC_build_series_mod(int64_t *parameters, int64_t *result,
+			   int64_t bound, int64_t prime)
+{
+	int64_t factors[2 * QSPC_MAX_NUM_QPS];
+	int64_t mark = QSPC_arena_mark();
+	int64_t *term = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+
+	for (int64_t index = 0; index < bound; ++index) result[index] = 0;
+
+	for (int64_t index = 0; index < 2 * QSPC_MAX_NUM_QPS; ++index)
+		factors[index] = 0;
+
+	term[0] = 1;
+
+	for (int64_t index = 1; index < bound; ++index) term[index] = 0;
+
+	for (int64_t index1 = 0;; ++index1) {
+		int64_t offset = QSPC_series_offset(parameters, index1);
+		int64_t flip = QSPC_series_sign(parameters, index1);
+
+		if (offset >= bound) break;
+
+		extend_series_term(parameters, factors, term, bound - offset,
+				   index1, prime);
+
+		for (int64_t index2 = 0; index2 < bound - offset; ++index2) {
+			int64_t *value = &result[index2 + offset];
+
+			if (flip == 1) {
+				*value += term[index2];
+
+				if (*value >= prime) *value -= prime;
+			} else {
+				*value -= term[index2];
+
+				if (*value < 0) *value += prime;
+			}
+		}
+	}
+
+	QSPC_arena_release(mark);
+}
+
+extern int64_t QSPC_mobius_divisors(struct QSPC_context *, int64_t,
+				    int64_t **, int64_t **);
+
+/* Factors a truncated series of residues as QSPC_find_product_form does,
+ * giving the residues of the powers modulo a prime.
+ *   context: The context whose divisors are used.
+ *   series: The residues of the series to be factored.
+ *   powers: The list of residues of the geometric series powers.
+ *   bound: The length of the series array, which must be below the prime.
+ *   prime: The modulus, which must be below 2^31. */
+void QSPC_find_product_form_mod(struct QSPC_context *context,
+				int64_t *series, int64_t *powers,
+				int64_t bound, int64_t prime)
+{
+	int64_t mark = QSPC_arena_mark();
+	int64_t *inverses = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	int64_t *derivative = QSPC_arena_alloc(bound
+		* (int64_t)sizeof(int64_t));
+
+	/* Every index below the bound is invertible, and the inverses follow
+	 * from $p = \lfloor p / i \rfloor i + (p \bmod i)$. */
+	inverses[1] = 1;
+
+	for (int64_t index = 2; index < bound; ++index) {
+		inverses[index] = prime - multiply_mod(prime / index,
+						       inverses[prime % index],
+						       prime);
+	}
+
+	powers[0] = 0;
+
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		int64_t value = multiply_mod(index1, series[index1], prime);
+		int64_t power = 0;
+		int64_t length;
+		int64_t *divisors;
+		int64_t *signs;
+
+		for (int64_t index2 = 1; index2 < index1; ++index2) {
+			value -= multiply_mod(derivative[index2],
+					      series[index1 - index2], prime);
+
+			if (value < 0) value += prime;
+		}
+
+		derivative[index1] = value;
+		length = QSPC_mobius_divisors(context, index1, &divisors,
+					      &signs);
+
+		for (int64_t index2 = 0; index2 < length; ++index2) {
+			if (signs[index2] > 0) {
+				power += derivative[divisors[index2]];
+
+				if (power >= prime) power -= prime;
+			} else {
+				power -= derivative[divisors[index2]];
+
+				if (power < 0) power += prime;
+			}
+		}
+
+		powers[index1] = multiply_mod(power, inverses[index1], prime);
+	}
+
+	QSPC_arena_release(mark);
+}
+
+/* Computes the powers of the product form of a q-series using modular
+ * arithmetic. Each power is rebuilt from its residues by the Chinese
+ * remainder theorem, as the value closest to 0, and then checked against
+ * its residue modulo the last prime. Returns false if any power failed this
+ * check or does not fit in int64_t.
+ *   context: The context of the search.
+ *   parameters: The parameters that encode the series.
+ *   powers: The list of powers of the factored series.
+ *   bound: The number of coefficients to use.
+ *   mismatched: Set to whether a power failed the check modulo the last
+ *     prime. */
+bool QSPC_modular_powers(struct QSPC_context *context, int64_t *parameters,
+			 int64_t *powers, int64_t bound, bool *mismatched)
+{
+	int64_t mark = QSPC_arena_mark();
+	int64_t (*residues)[bound] = QSPC_arena_alloc(QSPC_NUM_PRIMES * bound
+		* (int64_t)sizeof(int64_t));
+	int64_t *series = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	int64_t inverses[QSPC_NUM_PRIMES];
+	__int128 modulus = 1;
+	bool success = true;
+
+	*mismatched = false;
+
+	for (int64_t index = 0; index < QSPC_NUM_PRIMES; ++index) {
+		QSPC_build_series_mod(parameters, series, bound,
+				      QSPC_primes[index]);
+		QSPC_find_product_form_mod(context, series, residues[index],
+					   bound, QSPC_primes[index]);
+	}
+
+	/* Garner's algorithm needs the inverse of the product of the earlier
+	 * primes modulo each of the others. */
+	for (int64_t index1 = 1; index1 < QSPC_NUM_PRIMES - 1; ++index1) {
+		int64_t product = 1;
+
+		for (int64_t index2 = 0; index2 < index1; ++index2) {
+			product = multiply_mod(product,
+					       QSPC_primes[index2]
+					       % QSPC_primes[index1],
+					       QSPC_primes[index1]);
+		}
+
+		inverses[index1] = power_mod(product, QSPC_primes[index1] - 2,
+					     QSPC_primes[index1]);
+	}
+
+	for (int64_t index = 0; index < QSPC_NUM_PRIMES - 1; ++index)
+		modulus *= QSPC_primes[index];
+
+	powers[0] = 0;
+
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		__int128 value = residues[0][index1];
+		__int128 product = QSPC_primes[0];
+		int64_t check = QSPC_primes[QSPC_NUM_PRIMES - 1];
+
+		for (int64_t index2 = 1; index2 < QSPC_NUM_PRIMES - 1;
+		     ++index2) {
+			int64_t prime = QSPC_primes[index2];
+			int64_t digit = (residues[index2][index1]
+					- (int64_t)(value % prime)) % prime;
+
+			if (digit < 0) digit += prime;
+
+			digit = multiply_mod(digit, inverses[index2], prime);
+			value += product * digit;
+			product *= prime;
+		}
+
+		if (value > modulus / 2) value -= modulus;
+
+		if (value > INT64_MAX || value < INT64_MIN) {
+			success = false;
+			break;
+		}
+
+		if (((int64_t)(value % check) + check) % check
+		    != residues[QSPC_NUM_PRIMES - 1][index1]) {
+			*mismatched = true;
+			success = false;
+			break;
+		}
+
+		powers[index1] = (int64_t)value;
+	}
+
+	QSPC_arena_release(mark);
+
+	return success;
+}
+
+/* Helper function for QSPC_verify_identity. Expands the product side of an
+ * identity, $\prod_{k \ge 1} 1/(1-q^k)^{a_k}$, modulo a prime. The powers
+ * $a_k$ are taken to follow the pattern past the bound the identity was
+ * found at, and to differ from it only at the exceptions.
+ *   signature: The pattern of powers, followed by its exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions.
+ *   result: Where the residues of the product are written.
+ *   bound: The length of this array.
+ *   prime: The modulus. */
+static void expand_product_mod(int64_t *signature, int64_t period,
+			       int64_t exceptions, int64_t *result,
+			       int64_t bound, int64_t prime)
+{
+	result[0] = 1;
+
+	for (int64_t index = 1; index < bound; ++index) result[index] = 0;
+
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		int64_t power = signature[(index1 - 1) % period];
+
+		for (int64_t index2 = 0; index2 < exceptions; ++index2) {
+			if (signature[period + 2 * index2] == index1)
+				power = signature[period + 2 * index2 + 1];
+		}
+
+		for (; power > 0; --power)
+			divide_binomial(index1, 1, result, bound, prime);
+
+		for (; power < 0; ++power)
+			multiply_binomial(index1, 1, result, bound, prime);
+	}
+}
+
+/* Checks an identity the search found to more coefficients than it was
+ * found with, comparing its series to the product expanded from its
+ * signature. Both sides are worked out modulo each of the first
+ * QSPC_VERIFY_PRIMES primes, so nothing can overflow and a false identity
+ * only passes if every coefficient it gets wrong is off by a multiple of
+ * all of them. Returns true if the two sides agree.
+ *   parameters: The parameters that encode the series.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions.
+ *   bound: The number of coefficients to compare. */
+bool QSPC_verify_identity(int64_t *parameters, int64_t *signature,
+			  int64_t period, int64_t exceptions, int64_t bound)
+{
+	int64_t mark = QSPC_arena_mark();
+	int64_t *series = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	int64_t *product = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	bool success = true;
+
+	for (int64_t index1 = 0; success && index1 < QSPC_VERIFY_PRIMES;
+	     ++index1) {
+		int64_t prime = QSPC_primes[index1];
+
+		QSPC_build_series_mod(parameters, series, bound, prime);
+		expand_product_mod(signature, period, exceptions, product,
+				   bound, prime);
+
+		for (int64_t index2 = 0; index2 < bound; ++index2)
+			success &= series[index2] == product[index2];
+	}
+
+	QSPC_arena_release(mark);
+
+	return success;
+}
+
+extern bool QSPC_may_have_pattern(struct QSPC_context *, int64_t *, int64_t);
+
+/* Screening works on up to QSPC_SCREEN_LANES combinations at once, which
+ * share their q-Pochhammer symbols and only differ in the power and the sign
+ * in front of each summand. The summands are built once for all of them,
+ * and the coefficients of the series are laid out with one lane for each
+ * combination, so that factoring does the same arithmetic on every lane
+ * together. Each coefficient depends on the ones before it, but the lanes
+ * are independent, so the loops over them vectorize.
+ *
+ * The residues are kept below 2^32 in Montgomery form, as $x 2^{32}$ modulo
+ * QSPC_SCREEN_PRIME, so that products are reduced without any division.
+ * This needs the prime to be odd and below 2^31. */
+
+/* The inverse of QSPC_SCREEN_PRIME modulo 2^32, negated. Each step of
+ * Newton's method doubles the bits that are right, starting from 3. */
+#define SCREEN_NEWTON(inverse) ((uint32_t)(inverse) \
+	* (uint32_t)(2 - (uint32_t)QSPC_SCREEN_PRIME * (uint32_t)(inverse)))
+#define SCREEN_INVERSE ((uint32_t)-SCREEN_NEWTON(SCREEN_NEWTON( \
+	SCREEN_NEWTON(SCREEN_NEWTON(QSPC_SCREEN_PRIME)))))
+
+/* Returns a value below twice QSPC_SCREEN_PRIME reduced below it. This
+ * takes the smaller of the value and the value minus the prime, which wraps
+ * around if the value is already reduced, so that the loops over the lanes
+ * have no branches to stop them vectorizing. */
+static inline uint32_t subtract_screen(uint32_t value)
+{
+	uint32_t difference = value - QSPC_SCREEN_PRIME;
+
+	return difference < value ? difference : value;
+}
+
+/* Returns $x 2^{-32}$ modulo QSPC_SCREEN_PRIME, for x below the prime times
+ * 2^32. The product of two residues in Montgomery form reduces to the
+ * Montgomery form of their product. */
+static inline uint32_t reduce_screen(uint64_t value)
+{
+	uint32_t factor = (uint32_t)value * SCREEN_INVERSE;
+
+	return subtract_screen((uint32_t)((value + (uint64_t)factor
+					   * QSPC_SCREEN_PRIME) >> 32));
+}
+
+/* Returns the Montgomery form of a residue. */
+static inline uint32_t to_screen(int64_t value)
+{
+	uint64_t square = (UINT64_MAX % QSPC_SCREEN_PRIME + 1)
+			  % QSPC_SCREEN_PRIME;
+
+	return reduce_screen((uint64_t)value * square);
+}
+
+/* Helper function for screen_batch. Adds the series of each combination in
+ * a batch into its lane, modulo QSPC_SCREEN_PRIME.
+ *   parameters: The combinations, which share their symbols.
+ *   count: The number of combinations.
+ *   series: The lanes, each bound long, which must start out as 0.
+ *   bound: The number of coefficients of each series. */
+static void build_series_lanes(int64_t (*parameters)[QSPC_PARAMETER_LENGTH],
+			       int64_t count,
+			       uint32_t (*series)[QSPC_SCREEN_LANES],
+			       int64_t bound)
+{
+	int64_t factors[2 * QSPC_MAX_NUM_QPS];
+	int64_t mark = QSPC_arena_mark();
+	int64_t *term = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+
+	for (int64_t index = 0; index < 2 * QSPC_MAX_NUM_QPS; ++index)
+		factors[index] = 0;
+
+	term[0] = 1;
+
+	for (int64_t index = 1; index < bound; ++index) term[index] = 0;
+
+	for (int64_t index1 = 0;; ++index1) {
+		int64_t nearest = bound;
+
+		/* The summand is shared, and only needs as many terms as the
+		 * combination that puts it nearest to the start. */
+		for (int64_t lane = 0; lane < count; ++lane) {
+			int64_t offset = QSPC_series_offset(parameters[lane],
+							    index1);
+
+			if (offset < nearest) nearest = offset;
+		}
+
+		if (nearest >= bound) break;
+
+		extend_series_term(parameters[0], factors, term,
+				   bound - nearest, index1,
+				   QSPC_SCREEN_PRIME);
+
+		for (int64_t lane = 0; lane < count; ++lane) {
+			int64_t offset = QSPC_series_offset(parameters[lane],
+							    index1);
+			int64_t flip = QSPC_series_sign(parameters[lane],
+							index1);
+
+			for (int64_t index2 = 0; index2 < bound - offset;
+			     ++index2) {
+				uint32_t *value = &series[index2
+							  + offset][lane];
+				uint32_t summand = (uint32_t)(flip == 1
+					? term[index2] : QSPC_SCREEN_PRIME
+					- term[index2]);
+
+				*value = subtract_screen(*value + summand);
+			}
+		}
+	}
+
+	QSPC_arena_release(mark);
+}
+
+/* Helper function for QSPC_screen_batch. Works the same way for a batch as
+ * building and factoring each series modulo QSPC_SCREEN_PRIME with
+ * QSPC_build_series_mod and QSPC_find_product_form_mod, and then checking
+ * the powers with QSPC_may_have_pattern. */
+static inline __attribute__((always_inline))
+void screen_batch(struct QSPC_context *context,
+		  int64_t (*parameters)[QSPC_PARAMETER_LENGTH], int64_t count,
+		  bool *passed, int64_t bound)
+{
+	int64_t mark = QSPC_arena_mark();
+	int64_t lanes_size = bound * QSPC_SCREEN_LANES
+			     * (int64_t)sizeof(uint32_t);
+	uint32_t (*series)[QSPC_SCREEN_LANES] = QSPC_arena_alloc(lanes_size);
+	uint32_t (*derivative)[QSPC_SCREEN_LANES]
+		= QSPC_arena_alloc(lanes_size);
+	uint32_t (*powers)[QSPC_SCREEN_LANES] = QSPC_arena_alloc(lanes_size);
+	uint32_t *indices = QSPC_arena_alloc(bound
+		* (int64_t)sizeof(uint32_t));
+	int64_t *inverses = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	int64_t *lane_powers = QSPC_arena_alloc(bound
+		* (int64_t)sizeof(int64_t));
+
+	for (int64_t index = 0; index < bound; ++index) {
+		for (int64_t lane = 0; lane < QSPC_SCREEN_LANES; ++lane)
+			series[index][lane] = 0;
+	}
+
+	build_series_lanes(parameters, count, series, bound);
+
+	for (int64_t index = 0; index < bound; ++index) {
+		for (int64_t lane = 0; lane < QSPC_SCREEN_LANES; ++lane)
+			series[index][lane] = to_screen(series[index][lane]);
+	}
+
+	/* The same inverses as in QSPC_find_product_form_mod. */
+	inverses[1] = 1;
+
+	for (int64_t index = 2; index < bound; ++index) {
+		inverses[index] = QSPC_SCREEN_PRIME - multiply_mod(
+			QSPC_SCREEN_PRIME / index,
+			inverses[QSPC_SCREEN_PRIME % index],
+			QSPC_SCREEN_PRIME);
+	}
+
+	for (int64_t index = 1; index < bound; ++index) {
+		indices[index] = to_screen(index);
+		inverses[index] = to_screen(inverses[index]);
+	}
+
+	/* The lanes being worked out are kept apart from the arrays, so that
+	 * they are known not to overlap. */
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		uint32_t value[QSPC_SCREEN_LANES];
+		uint32_t power[QSPC_SCREEN_LANES];
+		int64_t length;
+		int64_t *divisors;
+		int64_t *signs;
+
+		for (int64_t lane = 0; lane < QSPC_SCREEN_LANES; ++lane) {
+			value[lane] = reduce_screen((uint64_t)indices[index1]
+						    * series[index1][lane]);
+			power[lane] = 0;
+		}
+
+		for (int64_t index2 = 1; index2 < index1; ++index2) {
+			uint32_t *factor1 = derivative[index2];
+			uint32_t *factor2 = series[index1 - index2];
+
+			for (int64_t lane = 0; lane < QSPC_SCREEN_LANES;
+			     ++lane) {
+				value[lane] = subtract_screen(value[lane]
+					+ QSPC_SCREEN_PRIME - reduce_screen(
+					(uint64_t)factor1[lane]
+					* factor2[lane]));
+			}
+		}
+
+		for (int64_t lane = 0; lane < QSPC_SCREEN_LANES; ++lane)
+			derivative[index1][lane] = value[lane];
+
+		length = QSPC_mobius_divisors(context, index1, &divisors,
+					      &signs);
+
+		for (int64_t index2 = 0; index2 < length; ++index2) {
+			uint32_t *term = derivative[divisors[index2]];
+
+			if (signs[index2] > 0) {
+				for (int64_t lane = 0; lane < QSPC_SCREEN_LANES;
+				     ++lane) {
+					power[lane] = subtract_screen(
+						power[lane] + term[lane]);
+				}
+			} else {
+				for (int64_t lane = 0; lane < QSPC_SCREEN_LANES;
+				     ++lane) {
+					power[lane] = subtract_screen(
+						power[lane] + QSPC_SCREEN_PRIME
+						- term[lane]);
+				}
+			}
+		}
+
+		for (int64_t lane = 0; lane < QSPC_SCREEN_LANES; ++lane) {
+			powers[index1][lane] = reduce_screen(
+				(uint64_t)power[lane]
+				* (uint32_t)inverses[index1]);
+		}
+	}
+
+	/* Only the equality of powers matters to the patterns, so they are
+	 * left in Montgomery form. */
+	lane_powers[0] = 0;
+
+	for (int64_t lane = 0; lane < count; ++lane) {
+		for (int64_t index = 1; index < bound; ++index)
+			lane_powers[index] = powers[index][lane];
+
+		passed[lane] = QSPC_may_have_pattern(context, lane_powers,
+						     bound);
+	}
+
+	QSPC_arena_release(mark);
+}
+
+/* Copies of screen_batch for the common screening bounds, with everything
+ * it calls inlined so that the loops have constant trip counts. */
+#define SCREEN_INSTANCE(bound) \
+	__attribute__((flatten)) \
+	static void screen_batch_##bound(struct QSPC_context *context, \
+					 int64_t (*parameters) \
+					 [QSPC_PARAMETER_LENGTH], \
+					 int64_t count, bool *passed) \
+	{ \
+		screen_batch(context, parameters, count, passed, bound); \
+	}
+
+SCREEN_INSTANCE(24)
+SCREEN_INSTANCE(32)
+
+static void screen_batch_any(struct QSPC_context *context,
+			     int64_t (*parameters)[QSPC_PARAMETER_LENGTH],
+			     int64_t count, bool *passed)
+{
+	screen_batch(context, parameters, count, passed,
+		     context->config.screen_bound);
+}
+
+/* Cheaply checks whether each combination in a batch could give an
+ * identity, before any exact arithmetic is done. The first coefficients of
+ * each series, up to the screening bound, are factored modulo
+ * QSPC_SCREEN_PRIME, and if the powers of a product have a pattern, their
+ * residues must have it too.
+ *   context: The context of the search.
+ *   parameters: The combinations, which must only differ in the last 4
+ *     parameters.
+ *   count: The number of combinations, at most QSPC_SCREEN_LANES.
+ *   passed: Set to false for each combination no pattern QSPC_find_pattern
+ *     looks for fits the residues of, and true for the others. */
+void QSPC_screen_batch(struct QSPC_context *context,
+		       int64_t (*parameters)[QSPC_PARAMETER_LENGTH],
+		       int64_t count, bool *passed)
+{
+	/* The copy of screen_batch is picked for each batch, since contexts
+	 * can differ in their screening bound. */
+	switch (context->config.screen_bound) {
+	case 0:
+		for (int64_t index = 0; index < count; ++index)
+			passed[index] = true;
+
+		break;
+	case 24:
+		screen_batch_24(context, parameters, count, passed);
+		break;
+	case 32:
+		screen_batch_32(context, parameters, count, passed);
+		break;
+	default:
+		screen_batch_any(context, parameters, count, passed);
+	}
+}
@@ -15,107 +15,357 @@ static int64_t gcd_pair(int64_t value1, int64_t value2)
 	return gcd_pair(value2 % value1, value2);
 }
 
-/* Returns the positive greatest common divisor of all the given values.
- *   pattern: An array of length modulus.
- *   modulus: Must be a positive integer. */
-int64_t QSPC_pattern_gcd(int64_t *pattern, int64_t modulus)
+/* Returns the positive greatest common divisor of the modulus and every
+ * power in a pattern, including those of its exceptions.
+ *   pattern: An array of length modulus, followed by the index and the
+ *     power of each exception.
+ *   modulus: Must be a positive integer.
+ *   exceptions: The number of exceptions. */
+int64_t QSPC_pattern_gcd(int64_t *pattern, int64_t modulus,
+			 int64_t exceptions)
 {
 	int64_t gcd = gcd_pair(modulus, pattern[0]);
 
 	for (int64_t index = 1; index < modulus; ++index) {
 		gcd = gcd_pair(pattern[index], gcd);
 
+		if (gcd == 1) return gcd;
+	}
+
+	for (int64_t index = 0; index < exceptions; ++index) {
+		gcd = gcd_pair(pattern[modulus + 2 * index + 1], gcd);
+
 		if (gcd == 1) break;
 	}
 
 	return gcd;
 }
 
-int64_t *QSPC_divisor_cache[QSPC_COEFFICIENT_BOUND];
-int64_t QSPC_divisor_values[QSPC_COEFFICIENT_BOUND];
+extern int64_t QSPC_arena_mark(void);
+extern void *QSPC_arena_alloc(int64_t);
+extern void QSPC_arena_release(int64_t);
+
+/* The divisors $d$ of every integer $n$ below the coefficient bound of a
+ * context with $\mu(n/d)$ nonzero, for Mobius inversion. They are in
+ * increasing order and flattened into one array, so that those of n are at
+ * offsets offsets[n] up to offsets[n + 1], and the values of $\mu(n/d)$ are
+ * alongside them. */
+struct QSPC_divisors
+{
+	int64_t *offsets;
+	int64_t *list;
+	int64_t *signs;
+};
 
-/* Sets *divisors to point to the array of divisors of the provided value.
- * Returns the number of divisors in this array. */
-int64_t QSPC_divisors(int64_t value, int64_t **divisors)
+/* Sets *divisors to point to the array of divisors $d$ of the provided
+ * value $n$ for which $\mu(n/d)$ is nonzero, and *signs to these values of
+ * $\mu(n/d)$. Returns the number of divisors in these arrays. */
+int64_t QSPC_mobius_divisors(struct QSPC_context *context, int64_t value,
+			     int64_t **divisors, int64_t **signs)
 {
-	*divisors = QSPC_divisor_cache[value];
+	struct QSPC_divisors *tables = context->divisors;
 
-	return QSPC_divisor_values[value];
+	*divisors = &tables->list[tables->offsets[value]];
+	*signs = &tables->signs[tables->offsets[value]];
+
+	return tables->offsets[value + 1] - tables->offsets[value];
 }
 
-/* Computes and stores the divisors of every integer between 0 and
- * QSPC_COEFFICIENT_BOUND. Called at program initialization. */
-void QSPC_generate_divisors(void)
+/* Computes and stores the divisors of every integer between 0 and the
+ * coefficient bound of a context that Mobius inversion needs, along with
+ * the Mobius function. Called when the context is created. */
+void QSPC_generate_divisors(struct QSPC_context *context)
 {
-	int64_t buffer[QSPC_COEFFICIENT_BOUND];
-	int64_t num_divisors;
-	size_t length;
-
-	for (int64_t index1 = 1; index1 < QSPC_COEFFICIENT_BOUND; ++index1) {
-		num_divisors = 0;
-
-		/* Brute force compute the divisors. This is only done once,
-		 * so there is little need for a more efficient method. */
-		for (int64_t index2 = 1; index2 <= index1 / 2; ++index2) {
-			if (index1 % index2 == 0) {
-				buffer[num_divisors++] = index2;
-			}
-		}
+	int64_t bound = context->config.coefficient_bound;
+	int64_t *mobius = calloc((size_t)bound, sizeof(int64_t));
+	struct QSPC_divisors *tables = malloc(sizeof(struct QSPC_divisors));
+	int64_t *offsets = calloc((size_t)bound + 1, sizeof(int64_t));
+	int64_t *list;
+	int64_t *signs;
+
+	/* Sieve the Mobius function from $\sum_{d \mid n} \mu(d) = 0$ for
+	 * every $n > 1$. */
+	if (bound > 1) mobius[1] = 1;
 
-		buffer[num_divisors++] = index1;
-		length = (size_t)num_divisors  * sizeof(int64_t);
-		QSPC_divisor_cache[index1] = malloc(length);
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		for (int64_t index2 = 2 * index1; index2 < bound;
+		     index2 += index1)
+			mobius[index2] -= mobius[index1];
+	}
+
+	/* Count the divisors of each integer to lay out the arrays. */
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		for (int64_t index2 = index1, multiple = 1; index2 < bound;
+		     index2 += index1, ++multiple)
+			offsets[index2 + 1] += mobius[multiple] != 0;
+	}
+
+	for (int64_t index = 0; index < bound; ++index)
+		offsets[index + 1] += offsets[index];
+
+	list = malloc((size_t)offsets[bound] * sizeof(int64_t));
+	signs = malloc((size_t)offsets[bound] * sizeof(int64_t));
 
-		for (int64_t index2 = 0; index2 < num_divisors; ++index2) {
-			QSPC_divisor_cache[index1][index2] = buffer[index2];
+	/* Going through the divisors in increasing order keeps every list
+	 * sorted. The offsets are moved along as the lists are filled, and
+	 * moved back after. */
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		for (int64_t index2 = index1, multiple = 1; index2 < bound;
+		     index2 += index1, ++multiple) {
+			if (mobius[multiple] == 0) continue;
+
+			list[offsets[index2]] = index1;
+			signs[offsets[index2]++] = mobius[multiple];
 		}
+	}
+
+	for (int64_t index = bound; index > 0; --index)
+		offsets[index] = offsets[index - 1];
+
+	offsets[0] = 0;
+	free(mobius);
 
-		QSPC_divisor_values[index1] = num_divisors;
+	tables->offsets = offsets;
+	tables->list = list;
+	tables->signs = signs;
+	context->divisors = tables;
+}
+
+/* Frees up the tables of divisors of a context. */
+void QSPC_delete_divisors(struct QSPC_context *context)
+{
+	struct QSPC_divisors *tables = context->divisors;
+
+	free(tables->offsets);
+	free(tables->list);
+	free(tables->signs);
+	free(tables);
+}
+
+/* Helper function for QSPC_find_pattern and QSPC_may_have_pattern. Finds
+ * the shortest period of a sequence in a single pass, from the prefix
+ * function of the Knuth-Morris-Pratt algorithm: the longest proper prefix of
+ * the sequence that is also a suffix leaves the period as what remains.
+ * Returns the smallest $p$ such that values[i] equals values[i + p]
+ * wherever both are in the sequence, or some value above the limit if $p$
+ * is.
+ *   values: The sequence, which must not be empty.
+ *   length: The length of this sequence.
+ *   limit: The longest period of interest. */
+static int64_t minimal_period(int64_t *values, int64_t length, int64_t limit)
+{
+	int64_t mark = QSPC_arena_mark();
+	int64_t *prefix = QSPC_arena_alloc(length * (int64_t)sizeof(int64_t));
+	int64_t border = 0;
+
+	prefix[0] = 0;
+
+	for (int64_t index = 1; index < length; ++index) {
+		while (border > 0 && values[index] != values[border])
+			border = prefix[border - 1];
+
+		if (values[index] == values[border]) ++border;
+
+		prefix[index] = border;
+
+		/* The period of a prefix can only grow with the prefix, so
+		 * most sequences are ruled out early. */
+		if (index + 1 - border > limit) {
+			length = index + 1;
+			break;
+		}
 	}
+
+	QSPC_arena_release(mark);
+
+	return length - border;
 }
 
-/* Frees up the list of divisors. Not important now, but may be useful if
- * the scope of this project becomes large enough. */
-void QSPC_delete_divisors(void)
+/* Helper function for count_exceptions. Returns how many of the powers at
+ * the given stride take the value most of them take, and writes that value
+ * to *value. Used only when no value is taken by more than half of them.
+ *   powers: The list of powers of the factored series.
+ *   first: The index of the first power.
+ *   length: The number of powers, including the first of the series.
+ *   period: The stride between the powers. */
+static int64_t most_common(int64_t *powers, int64_t first, int64_t length,
+			   int64_t period, int64_t *value)
 {
-	for (int64_t index = 1; index < QSPC_COEFFICIENT_BOUND; ++index)
-		free(QSPC_divisor_cache[index]);
+	int64_t best = 0;
+
+	for (int64_t index1 = first; index1 < length; index1 += period) {
+		int64_t count = 0;
+
+		for (int64_t index2 = first; index2 < length; index2 += period)
+			count += powers[index2] == powers[index1];
+
+		if (count > best) {
+			best = count;
+			*value = powers[index1];
+		}
+	}
+
+	return best;
 }
 
-/* Helper function for QSPC_find_pattern. Checks a particular pattern length.
- * Returns true if the pattern exists, and false otherwise.
+/* Helper function for QSPC_find_pattern and QSPC_may_have_pattern. Counts
+ * the powers after the preperiod that disagree with the best pattern of a
+ * given length, where each entry of the pattern is the value most of its
+ * powers take. Returns this count, or a larger one once it is past the
+ * number of exceptions allowed.
+ *   config: The settings of the search.
  *   powers: The list of powers of the factored series.
- *   period: The pattern length to check. */
-static bool check_period(int64_t *powers, int64_t period)
+ *   length: The number of powers to check, including the first.
+ *   period: The pattern length to check.
+ *   pattern: Where the pattern is written, or NULL.
+ *   majority: Set to false if some entry of the pattern is not taken by
+ *     more than half of its powers, and true otherwise. */
+static int64_t count_exceptions(const struct QSPC_config *config,
+				int64_t *powers, int64_t length,
+				int64_t period, int64_t *pattern,
+				bool *majority)
 {
-	for (int64_t index1 = 0;; ++index1) {
-		for (int64_t index2 = 1; index2 <= period; ++index2) {
+	int64_t start = config->preperiod + 1;
+	int64_t exceptions = 0;
+
+	*majority = true;
+
+	for (int64_t offset = 0; offset < period; ++offset) {
+		int64_t first = start + (offset - (start - 1) % period + period)
+				% period;
+		int64_t candidate = 0;
+		int64_t votes = 0;
+		int64_t size = 0;
+		int64_t best = 0;
+
+		/* A vote of each power against the others leaves the value
+		 * taken by more than half of them, if there is one. */
+		for (int64_t index = first; index < length; index += period) {
+			if (votes == 0) candidate = powers[index];
+
+			votes += powers[index] == candidate ? 1 : -1;
+			++size;
+		}
+
+		for (int64_t index = first; index < length; index += period)
+			best += powers[index] == candidate;
 
-			if (period * index1 + index2
-			    == QSPC_COEFFICIENT_BOUND) return true;
+		/* Otherwise at least half of the powers are exceptions, which
+		 * only leaves few enough to count them all. */
+		if (2 * best <= size) {
+			*majority = false;
 
-			if (powers[index2] != powers[period * index1
-			    + index2]) return false;
+			if (size - size / 2 <= config->max_exceptions
+			    - exceptions) {
+				best = most_common(powers, first, length,
+						   period, &candidate);
+			}
 		}
+
+		if (pattern != NULL) pattern[offset] = candidate;
+
+		exceptions += size - best;
+
+		if (exceptions > config->max_exceptions) break;
 	}
+
+	return exceptions;
 }
 
-/* Looks for a repeating pattern in the powers of a factored series. Returns
+/* Looks for a repeating pattern in the powers of a factored series, up to
+ * the pattern bound of a context. Powers in the preperiod need not follow
+ * it, and up to the number of exceptions allowed of the others need not
+ * either, as long as each entry of the pattern is taken by most of its
+ * powers. A pattern that every power follows is always preferred. Returns
  * the length of the pattern if it exists, or 0 otherwise.
+ *   context: The context the powers were found in.
  *   powers: The list of powers of the factored series.
- *   pattern: If a pattern is found, the sequence is written here. */
-int64_t QSPC_find_pattern(int64_t *powers, int64_t *pattern)
+ *   pattern: If a pattern is found, the sequence is written here, followed
+ *     by the index and the power of each exception to it in turn.
+ *   exceptions: Set to the number of exceptions. */
+int64_t QSPC_find_pattern(struct QSPC_context *context, int64_t *powers,
+			  int64_t *pattern, int64_t *exceptions)
 {
-	for (int64_t index1 = 1; index1 <= QSPC_PATTERN_BOUND; ++index1) {
-		if (!check_period(powers, index1)) continue;
+	const struct QSPC_config *config = &context->config;
+	int64_t length = config->coefficient_bound;
+	int64_t start = config->preperiod + 1;
+	int64_t period = minimal_period(&powers[1], length - 1,
+					config->pattern_bound);
+	bool majority;
+
+	*exceptions = 0;
+
+	if (period <= config->pattern_bound) {
+		for (int64_t index = 0; index < period; ++index)
+			pattern[index] = powers[index + 1];
 
-		for (int64_t index2 = 0; index2 < index1; ++index2) {
-			pattern[index2] = powers[index2 + 1];
+		return period;
+	}
+
+	if (config->max_exceptions == 0) {
+		if (config->preperiod == 0) return 0;
+
+		/* Only the preperiod is exempt, so the rest of the powers
+		 * have to repeat exactly. */
+		period = minimal_period(&powers[start], length - start,
+					config->pattern_bound);
+
+		if (period > config->pattern_bound) return 0;
+
+		for (int64_t index = start; index < start + period; ++index)
+			pattern[(index - 1) % period] = powers[index];
+	} else {
+		for (period = 1; period <= config->pattern_bound;
+		     ++period) {
+			if (count_exceptions(config, powers, length, period,
+					     pattern, &majority)
+			    <= config->max_exceptions && majority) break;
 		}
 
-		return index1;
+		if (period > config->pattern_bound) return 0;
 	}
 
-	return 0;
+	for (int64_t index = 1; index < length; ++index) {
+		if (powers[index] == pattern[(index - 1) % period]) continue;
+
+		pattern[period + 2 * *exceptions] = index;
+		pattern[period + 2 * *exceptions + 1] = powers[index];
+		++*exceptions;
+	}
+
+	return period;
 }
 
+/* Returns true if some pattern that QSPC_find_pattern looks for is consistent
+ * with the first few powers of a factored series, and false otherwise.
+ *   context: The context the powers were found in.
+ *   powers: The list of powers of the factored series.
+ *   length: The number of powers known, including the first. */
+bool QSPC_may_have_pattern(struct QSPC_context *context, int64_t *powers,
+			   int64_t length)
+{
+	const struct QSPC_config *config = &context->config;
+	int64_t start = config->preperiod + 1;
+	bool majority;
+
+	if (length <= start) return true;
+
+	/* Every pattern found without exceptions repeats exactly after the
+	 * preperiod, and so does every prefix of the powers. */
+	if (minimal_period(&powers[start], length - start,
+			   config->pattern_bound)
+	    <= config->pattern_bound) return true;
+
+	if (config->max_exceptions == 0) return false;
+
+	/* The best pattern for the prefix has the fewest exceptions there,
+	 * and more powers can only add to the exceptions of any pattern. */
+	for (int64_t period = 1; period <= config->pattern_bound;
+	     ++period) {
+		if (count_exceptions(config, powers, length, period, NULL,
+				     &majority)
+		    <= config->max_exceptions) return true;
+	}
+
+	return false;
+}
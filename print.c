@@ -1,10 +1,21 @@
-#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include "qspc.h"
 
-pthread_mutex_t QSPC_print_lock;
+/* Prints the start of the LaTeX file, before any identities. */
+void QSPC_print_header(void)
+{
+	printf("\\documentclass[10pt]{article}\n");
+	printf("\\usepackage{amsmath}\n");
+	printf("\\usepackage[margin=0.1in]{geometry}\n\\begin{document}\n");
+}
+
+/* Prints the end of the LaTeX file, after every identity. */
+void QSPC_print_footer(void)
+{
+	printf("\\end{document}\n");
+}
 
 /* Helper function for QSPC_report_identity that nicely prints powers of q. */
 static inline void print_power(int64_t power)
@@ -14,77 +25,18 @@ static inline void print_power(int64_t power)
 	} else if (power == 1) {
 		printf(" q ");
 	} else {
-		printf(" q^{%lld} ", power);
+		printf(" q^{%lld} ", (long long)power);
 	}
 }
 
-/* Prints out a sum-product identity formatted in LaTeX.
- *   parameters: The series parameters.
- *   signature: The pattern of powers for the product.
- *   modulus: The length of signature. */
-void QSPC_report_identity(int64_t *parameters, int64_t *signature,
-			  int64_t modulus)
+/* Helper function for QSPC_report_identity. Prints the sum side of an
+ * identity.
+ *   parameters: The series parameters. */
+static void print_sum(int64_t *parameters)
 {
-	bool product_frac = false;
-	bool numerator_empty = true;
 	int64_t num_qps = QSPC_num_qps(parameters);
 	int64_t den_qps = QSPC_den_qps(parameters);
 
-	/* This function needs to be thread safe. */
-	pthread_mutex_lock(&QSPC_print_lock);
-
-	printf("\\begin{equation}\n");
-
-	/* Arbitrary choice to help equations fit on the page. */
-	if (modulus >= 10) {
-		printf("\\begin{aligned}\n&");
-	}
-
-	for (int64_t index = 0; index < modulus; ++index) {
-		if (signature[index] > 0) {
-			product_frac = true;
-			break;
-		}
-	}
-
-	if (product_frac) printf("\\frac{");
-
-	for (int64_t index = 0; index < modulus; ++index) {
-		if (signature[index] >= 0) continue;
-
-		printf("(");
-		print_power(index + 1);
-		printf("; q^{%lld})_\\infty ", modulus);
-
-		if (signature[index] != -1) printf("^{%lld}",
-		    -signature[index]);
-
-		numerator_empty = false;
-	}
-
-	if (product_frac) {
-		if (numerator_empty) printf("1");
-
-		printf("}{");
-
-		for (int64_t index = 0; index < modulus; ++index) {
-			if (signature[index] <= 0) continue;
-
-			printf("(");
-			print_power(index + 1);
-			printf("; q^{%lld})_\\infty ", modulus);
-
-			if (signature[index] != 1)
-				printf("^{%lld}", signature[index]);
-		}
-
-		printf("}");
-	}
-
-	if (modulus == 1 && signature[0] == 0) printf("1");
-
-	if (modulus >= 10) printf("\\\\&");
-
 	printf(" = \\sum_{n=0}^\\infty ");
 
 	if (den_qps != 0) printf("\\frac{");
@@ -99,7 +51,8 @@ void QSPC_report_identity(int64_t *parameters, int64_t *signature,
 	if (parameters[QSPC_PARAMETER_LENGTH - 4] == 1) {
 		printf("n^2");
 	} else if (parameters[QSPC_PARAMETER_LENGTH - 4] > 1) {
-		printf("%lld n^2", parameters[QSPC_PARAMETER_LENGTH - 4]);
+		printf("%lld n^2",
+		       (long long)parameters[QSPC_PARAMETER_LENGTH - 4]);
 	}
 
 	if (parameters[QSPC_PARAMETER_LENGTH - 4] != 0 &&
@@ -109,13 +62,15 @@ void QSPC_report_identity(int64_t *parameters, int64_t *signature,
 	if (parameters[QSPC_PARAMETER_LENGTH - 3] == 1) {
 		printf("n");
 	} else if (parameters[QSPC_PARAMETER_LENGTH - 3] > 1) {
-		printf("%lld n", parameters[QSPC_PARAMETER_LENGTH - 3]);
+		printf("%lld n",
+		       (long long)parameters[QSPC_PARAMETER_LENGTH - 3]);
 	}
 
 	if (parameters[QSPC_PARAMETER_LENGTH - 2] != 1) {
 		if (parameters[QSPC_PARAMETER_LENGTH - 3] != 0) printf(")");
 
-		printf("/%lld", parameters[QSPC_PARAMETER_LENGTH - 2]);
+		printf("/%lld",
+		       (long long)parameters[QSPC_PARAMETER_LENGTH - 2]);
 	}
 
 	printf("}");
@@ -131,24 +86,17 @@ void QSPC_report_identity(int64_t *parameters, int64_t *signature,
 		if (parameters[4 * index + 0] == 1) {
 			printf("_{n");
 		} else {
-			printf("_{%lld n", parameters[4 * index + 0]);
+			printf("_{%lld n",
+			       (long long)parameters[4 * index + 0]);
 		}
 
 		if (parameters[4 * index + 1] != 0)
-			printf(" + %lld", parameters[4 * index + 1]);
+			printf(" + %lld", (long long)parameters[4 * index + 1]);
 
 		printf("}");
 	}
 
-	if (den_qps == 0) {
-		if (modulus >= 10) {
-			printf("\n\\end{aligned}");
-		}
-
-		printf("\n\\end{equation}\n\n");
-		pthread_mutex_unlock(&QSPC_print_lock);
-		return;
-	}
+	if (den_qps == 0) return;
 
 	printf("}{");
 
@@ -163,24 +111,143 @@ void QSPC_report_identity(int64_t *parameters, int64_t *signature,
 		if (parameters[4 * QSPC_MAX_NUM_QPS + 4 * index + 0] == 1) {
 			printf("_{n");
 		} else {
-			printf("_{%lld n", parameters[4 * QSPC_MAX_NUM_QPS
-						      + 4 * index + 0]);
+			printf("_{%lld n",
+			       (long long)parameters[4 * QSPC_MAX_NUM_QPS
+						     + 4 * index + 0]);
 		}
 
 		if (parameters[4 * QSPC_MAX_NUM_QPS + 4 * index + 1] != 0)
-			printf(" + %lld", parameters[4 * QSPC_MAX_NUM_QPS
+			printf(" + %lld",
+			       (long long)parameters[4 * QSPC_MAX_NUM_QPS
 						     + 4 * index + 1]);
 
 		printf("}");
 	}
 
-	if (modulus >= 10) {
-		printf("}\n\\end{aligned}");
-		printf("\n\\end{equation}\n\n");
-	} else {
-		printf("}\n\\end{equation}\n\n");
+	printf("}");
+}
+
+/* Helper function for QSPC_report_identity. Prints the factors that correct
+ * the product for its exceptions, on one side of the fraction. An exception
+ * at $q^k$ with power $a$ where the pattern has $b$ is corrected by the
+ * factor $(1-q^k)^{b-a}$. Returns true if any factor was printed.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   modulus: The length of the pattern.
+ *   exceptions: The number of exceptions.
+ *   numerator: Set to true for the numerator, and false for the
+ *     denominator. */
+static bool print_exceptions(int64_t *signature, int64_t modulus,
+			     int64_t exceptions, bool numerator)
+{
+	bool printed = false;
+
+	for (int64_t index = 0; index < exceptions; ++index) {
+		int64_t position = signature[modulus + 2 * index];
+		int64_t power = signature[(position - 1) % modulus]
+				- signature[modulus + 2 * index + 1];
+
+		if (numerator ? power <= 0 : power >= 0) continue;
+
+		if (power < 0) power = -power;
+
+		printf("(1 -");
+		print_power(position);
+		printf(")");
+
+		if (power != 1) printf("^{%lld}", (long long)power);
+
+		printed = true;
 	}
 
-	pthread_mutex_unlock(&QSPC_print_lock);
+	return printed;
 }
 
+/* Prints out a sum-product identity formatted in LaTeX, along with any
+ * other sums equal to the same product.
+ *   parameters: The parameters of each series, one after another.
+ *   num_sums: The number of series.
+ *   signature: The pattern of powers for the product, followed by the
+ *     index and the power of each exception to it.
+ *   modulus: The length of the pattern.
+ *   exceptions: The number of exceptions. */
+void QSPC_report_identity(int64_t *parameters, int64_t num_sums,
+			  int64_t *signature, int64_t modulus,
+			  int64_t exceptions)
+{
+	bool product_frac = false;
+	bool numerator_empty = true;
+
+	/* Arbitrary choice to help equations fit on the page. */
+	bool aligned = modulus >= 10 || num_sums > 1;
+
+	printf("\\begin{equation}\n");
+
+	if (aligned) {
+		printf("\\begin{aligned}\n&");
+	}
+
+	for (int64_t index = 0; index < modulus; ++index) {
+		if (signature[index] > 0) {
+			product_frac = true;
+			break;
+		}
+	}
+
+	for (int64_t index = 0; index < exceptions; ++index) {
+		int64_t position = signature[modulus + 2 * index];
+
+		if (signature[modulus + 2 * index + 1]
+		    > signature[(position - 1) % modulus]) product_frac = true;
+	}
+
+	if (product_frac) printf("\\frac{");
+
+	for (int64_t index = 0; index < modulus; ++index) {
+		if (signature[index] >= 0) continue;
+
+		printf("(");
+		print_power(index + 1);
+		printf("; q^{%lld})_\\infty ", (long long)modulus);
+
+		if (signature[index] != -1)
+			printf("^{%lld}", -(long long)signature[index]);
+
+		numerator_empty = false;
+	}
+
+	if (print_exceptions(signature, modulus, exceptions, true))
+		numerator_empty = false;
+
+	if (product_frac) {
+		if (numerator_empty) printf("1");
+
+		printf("}{");
+
+		for (int64_t index = 0; index < modulus; ++index) {
+			if (signature[index] <= 0) continue;
+
+			printf("(");
+			print_power(index + 1);
+			printf("; q^{%lld})_\\infty ", (long long)modulus);
+
+			if (signature[index] != 1)
+				printf("^{%lld}", (long long)signature[index]);
+		}
+
+		print_exceptions(signature, modulus, exceptions, false);
+		printf("}");
+	}
+
+	if (!product_frac && numerator_empty) printf("1");
+
+	for (int64_t index = 0; index < num_sums; ++index) {
+		if (aligned) printf("\\\\&");
+
+		print_sum(&parameters[index * QSPC_PARAMETER_LENGTH]);
+	}
+
+	if (aligned) printf("\n\\end{aligned}");
+
+	printf("\n\\end{equation}\n\n");
+}
@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "qspc.h"
+
+extern struct QSPC_config QSPC_config;
+
+/* While a search runs, a thread wakes up every so often to add up the
+ * counters of the workers and report on stderr how far along the search is.
+ * Every root holds the same number of combinations, so the fraction of the
+ * roots searched is also the fraction of the work done, up to the roots not
+ * costing the same to screen. */
+
+/* The reporting thread, and how it is told to stop. */
+static pthread_t progress_thread;
+static pthread_mutex_t progress_lock;
+static pthread_cond_t progress_cond;
+static bool progress_stop;
+
+/* The context being searched, the roots this shard searches, and when it
+ * started. */
+static struct QSPC_context *progress_context;
+static int64_t progress_roots;
+static int64_t progress_start;
+
+/* Helper function for report_progress. Prints a number of seconds as hours,
+ * minutes and seconds. */
+static void print_duration(double seconds)
+{
+	int64_t whole = (int64_t)(seconds + 0.5);
+
+	fprintf(stderr, "%lld:%02lld:%02lld", (long long)(whole / 3600),
+		(long long)(whole / 60 % 60), (long long)(whole % 60));
+}
+
+/* Prints a line on how far along the search is. */
+static void report_progress(void)
+{
+	int64_t counters[QSPC_NUM_COUNTERS];
+	int64_t searched;
+	int64_t done;
+	double elapsed = (double)(QSPC_time_ns() - progress_start) / 1e9;
+
+	QSPC_collect_counters(progress_context, counters);
+	searched = counters[QSPC_COUNT_ROOTS];
+	done = searched + counters[QSPC_COUNT_ROOTS_SKIPPED]
+	       + counters[QSPC_COUNT_ROOTS_REUSED];
+
+	fprintf(stderr, "Progress: %lld of %lld roots (%.1f%%), %lld "
+		"combinations at %.0f/s, %lld identities, ETA ",
+		(long long)done, (long long)progress_roots,
+		progress_roots == 0 ? 100.0 : 100.0 * (double)done
+		/ (double)progress_roots,
+		(long long)counters[QSPC_COUNT_COMBINATIONS],
+		(double)counters[QSPC_COUNT_COMBINATIONS] / elapsed,
+		(long long)counters[QSPC_COUNT_IDENTITIES]);
+
+	/* Roots finished before resuming or in an earlier run say nothing
+	 * about the rate. */
+	if (searched == 0) {
+		fprintf(stderr, "unknown\n");
+	} else {
+		print_duration(elapsed * (double)(progress_roots - done)
+			       / (double)searched);
+		fprintf(stderr, "\n");
+	}
+}
+
+/* Entry point for the reporting thread. */
+static void *progress_main(void *argument)
+{
+	struct timespec deadline;
+
+	(void)argument;
+
+	pthread_mutex_lock(&progress_lock);
+
+	while (!progress_stop) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += QSPC_config.progress_interval;
+
+		while (!progress_stop) {
+			if (pthread_cond_timedwait(&progress_cond,
+						   &progress_lock,
+						   &deadline) == ETIMEDOUT)
+				break;
+		}
+
+		if (progress_stop) break;
+
+		/* Other threads only take the lock to stop this one. */
+		pthread_mutex_unlock(&progress_lock);
+		report_progress();
+		pthread_mutex_lock(&progress_lock);
+	}
+
+	pthread_mutex_unlock(&progress_lock);
+
+	return NULL;
+}
+
+/* Starts reporting progress, if it is enabled. The workers must already be
+ * set up.
+ *   context: The context being searched. */
+void QSPC_start_progress(struct QSPC_context *context)
+{
+	int64_t roots = QSPC_count_roots(context);
+	int64_t shard = QSPC_config.shard_index;
+
+	progress_context = context;
+	progress_start = QSPC_time_ns();
+	progress_roots = shard < roots ? (roots - shard - 1)
+			 / QSPC_config.shard_count + 1 : 0;
+
+	if (QSPC_config.progress_interval == 0) return;
+
+	pthread_mutex_init(&progress_lock, NULL);
+	pthread_cond_init(&progress_cond, NULL);
+	progress_stop = false;
+	pthread_create(&progress_thread, NULL, progress_main, NULL);
+}
+
+/* Stops reporting progress. */
+void QSPC_stop_progress(void)
+{
+	if (QSPC_config.progress_interval == 0) return;
+
+	pthread_mutex_lock(&progress_lock);
+	progress_stop = true;
+	pthread_cond_signal(&progress_cond);
+	pthread_mutex_unlock(&progress_lock);
+	pthread_join(progress_thread, NULL);
+
+	pthread_mutex_destroy(&progress_lock);
+	pthread_cond_destroy(&progress_cond);
+}
+
+/* Prints a summary of where the combinations went and where the time went,
+ * once the search is over.
+ *   counters: The totals over the workers. */
+void QSPC_report_counters(int64_t *counters)
+{
+	int64_t passed = counters[QSPC_COUNT_SCREEN_PASSED];
+	double powers = (double)counters[QSPC_COUNT_POWERS_TIME] / 1e9;
+	double pattern = (double)counters[QSPC_COUNT_PATTERN_TIME] / 1e9;
+	double idle = (double)counters[QSPC_COUNT_IDLE_TIME] / 1e9;
+	double total = (double)counters[QSPC_COUNT_TOTAL_TIME] / 1e9;
+
+	fprintf(stderr, "Combinations: %lld tried in %lld roots, %lld "
+		"identities\n", (long long)counters[QSPC_COUNT_COMBINATIONS],
+		(long long)counters[QSPC_COUNT_ROOTS],
+		(long long)counters[QSPC_COUNT_IDENTITIES]);
+	fprintf(stderr, "Screening: %lld passed, %lld rejected\n",
+		(long long)passed,
+		(long long)(counters[QSPC_COUNT_COMBINATIONS] - passed));
+	fprintf(stderr, "Rejected: %lld without exact powers, %lld without "
+		"a pattern, %lld dilated\n",
+		(long long)counters[QSPC_COUNT_NO_POWERS],
+		(long long)counters[QSPC_COUNT_NO_PATTERN],
+		(long long)counters[QSPC_COUNT_DILATED]);
+	fprintf(stderr, "Pruned: %lld combinations dilating another\n",
+		(long long)counters[QSPC_COUNT_PRUNED_DILATED]);
+	fprintf(stderr, "Reused: %lld roots and %lld combinations searched "
+		"before\n", (long long)counters[QSPC_COUNT_ROOTS_REUSED],
+		(long long)counters[QSPC_COUNT_REUSED]);
+	fprintf(stderr, "Series memo: %lld hits, %lld misses\n",
+		(long long)counters[QSPC_COUNT_MEMO_HITS],
+		(long long)counters[QSPC_COUNT_MEMO_MISSES]);
+	fprintf(stderr, "Verification: %lld verified to %lld coefficients, "
+		"%lld failed, %.2fs\n",
+		(long long)counters[QSPC_COUNT_VERIFIED],
+		(long long)QSPC_verified_bound(&QSPC_config),
+		(long long)counters[QSPC_COUNT_VERIFY_FAILED],
+		(double)counters[QSPC_COUNT_VERIFY_TIME] / 1e9);
+
+	/* Screening is not timed itself, being most of the work, so it is
+	 * counted together with going through the combinations. */
+	fprintf(stderr, "Thread time: %.2fs screening, %.2fs finding powers, "
+		"%.2fs finding patterns, %.2fs idle\n",
+		total - powers - pattern - idle, powers, pattern, idle);
+}
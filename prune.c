@@ -0,0 +1,196 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+/* Many combinations of parameters give a series that is already given by
+ * another combination, or that follows trivially from one, so they can be
+ * thrown out before any series is built:
+ *
+ *   Symbols in the numerator or the denominator can come in any order, but
+ *   only the order that is lexicographically nonincreasing in c, d, a and b
+ *   is kept. The search never numbers roots in any other order, so these
+ *   are left out without ever being looked at.
+ *
+ *   If some $g > 1$ divides a and b of every symbol as well as every power
+ *   in front of the summands, then the series is $F(q^g)$ for the series F
+ *   of the combination with these divided by g, which is also searched.
+ *
+ * A symbol in the numerator never cancels one in the denominator, as the
+ * numerator symbols are $(-q^a; q^b)$ and those of the denominator are
+ * $(q^a; q^b)$. */
+
+/* Helper function for QSPC_dilation. Returns the greatest common divisor of
+ * two nonnegative values. */
+static int64_t common_divisor(int64_t value1, int64_t value2)
+{
+	while (value2 != 0) {
+		int64_t remainder = value1 % value2;
+
+		value1 = value2;
+		value2 = remainder;
+	}
+
+	return value1;
+}
+
+/* Returns the largest g such that the series of a combination is $F(q^g)$
+ * for the series F of another combination, as described above. This is 1
+ * if the series is not dilated.
+ *   parameters: The parameters that encode the series. Every one but the
+ *     sign needs to be chosen. */
+int64_t QSPC_dilation(int64_t *parameters)
+{
+	/* Every power $(\alpha n^2 + \beta n) / \gamma$ is a combination of
+	 * the first two with integer coefficients. */
+	int64_t dilation = common_divisor(QSPC_series_offset(parameters, 1),
+					  QSPC_series_offset(parameters, 2));
+
+	for (int64_t index = 0; index < 2 * QSPC_MAX_NUM_QPS
+	     && dilation > 1; ++index) {
+		int64_t *symbol = &parameters[4 * index];
+
+		if (symbol[0] == 0) continue;
+
+		dilation = common_divisor(dilation, symbol[2]);
+		dilation = common_divisor(dilation, symbol[3]);
+	}
+
+	return dilation;
+}
+
+/* Regions of the search done before, as the settings they were searched
+ * with. A combination is only in a region if each of its parameters is
+ * within the ranges of the settings, which the search goes through in the
+ * same way whatever the ranges are, so a run over wider ranges can skip
+ * every combination that an earlier one tried. */
+struct QSPC_regions
+{
+	struct QSPC_config *list;
+	int64_t count;
+};
+
+/* Helper function for QSPC_in_region and QSPC_region_searched. Returns true
+ * if every combination that starts with some parameters is in a region.
+ *   region: The settings the region was searched with.
+ *   config: The settings of the search, which bound the parameters not
+ *     chosen yet.
+ *   parameters: The parameters that encode the series.
+ *   depth: The number of parameters chosen. */
+static bool covers(const struct QSPC_config *region,
+		   const struct QSPC_config *config, int64_t *parameters,
+		   int64_t depth)
+{
+	const int64_t limits[4] = {region->max_fac_deg_1,
+				   region->max_fac_deg_0, region->max_dil_1,
+				   region->max_dil_2};
+	int64_t *power = &parameters[QSPC_PARAMETER_LENGTH - 4];
+
+	for (int64_t half = 0; half < 2; ++half) {
+		for (int64_t index1 = 0; index1 < QSPC_MAX_NUM_QPS; ++index1) {
+			int64_t start = 4 * QSPC_MAX_NUM_QPS * half
+					+ 4 * index1;
+
+			if (start >= depth || parameters[start] == 0) break;
+
+			if (index1 >= region->num_qps) return false;
+
+			for (int64_t index2 = 0; index2 < 4
+			     && start + index2 < depth; ++index2) {
+				if (parameters[start + index2]
+				    > limits[index2])
+					return false;
+			}
+		}
+	}
+
+	/* Any parameter left to choose can go as far as the search goes. */
+	if (depth < 8 * QSPC_MAX_NUM_QPS
+	    && (config->num_qps > region->num_qps
+		|| config->max_fac_deg_1 > region->max_fac_deg_1
+		|| config->max_fac_deg_0 > region->max_fac_deg_0
+		|| config->max_dil_1 > region->max_dil_1
+		|| config->max_dil_2 > region->max_dil_2))
+		return false;
+
+	if (depth <= QSPC_PARAMETER_LENGTH - 4) {
+		if (config->max_power_deg_2 > region->max_power_deg_2)
+			return false;
+	} else if (power[0] >= region->max_power_deg_2) {
+		return false;
+	}
+
+	if (depth <= QSPC_PARAMETER_LENGTH - 3)
+		return config->max_power_deg_1 <= region->max_power_deg_1;
+
+	return power[1] < region->max_power_deg_1;
+}
+
+/* Returns true if a combination is in the region searched with the given
+ * settings.
+ *   region: The settings the region was searched with.
+ *   parameters: The parameters that encode the series. Every one but the
+ *     sign needs to be chosen. */
+bool QSPC_in_region(const struct QSPC_config *region, int64_t *parameters)
+{
+	return covers(region, region, parameters, QSPC_PARAMETER_LENGTH - 1);
+}
+
+/* Returns true if every combination that starts with some parameters is in
+ * a region searched before, and so can be skipped.
+ *   context: The context of the search.
+ *   parameters: The parameters that encode the series.
+ *   depth: The number of parameters chosen. */
+bool QSPC_region_searched(struct QSPC_context *context, int64_t *parameters,
+			  int64_t depth)
+{
+	struct QSPC_regions *regions = context->regions;
+
+	for (int64_t index = 0; index < regions->count; ++index) {
+		if (covers(&regions->list[index], &context->config,
+			   parameters, depth))
+			return true;
+	}
+
+	return false;
+}
+
+/* Tells a context that the combinations in a region were searched before,
+ * so that its searches skip them. This is only done if the region was
+ * searched for the same identities, which takes the same bounds on the
+ * coefficients and the patterns. Returns true if it was.
+ *   context: The context, which must have no search running on it.
+ *   region: The settings the region was searched with. */
+bool QSPC_add_searched_region(struct QSPC_context *context,
+			      const struct QSPC_config *region)
+{
+	struct QSPC_regions *regions = context->regions;
+	const struct QSPC_config *config = &context->config;
+
+	if (region->coefficient_bound != config->coefficient_bound
+	    || region->pattern_bound != config->pattern_bound
+	    || region->preperiod != config->preperiod
+	    || region->max_exceptions != config->max_exceptions
+	    || QSPC_verified_bound(region) != QSPC_verified_bound(config))
+		return false;
+
+	regions->list = realloc(regions->list, (size_t)(regions->count + 1)
+				* sizeof(struct QSPC_config));
+	regions->list[regions->count++] = *region;
+
+	return true;
+}
+
+/* Sets up a context with no regions searched before. Called when the
+ * context is created. */
+void QSPC_create_regions(struct QSPC_context *context)
+{
+	context->regions = calloc(1, sizeof(struct QSPC_regions));
+}
+
+/* Frees up the regions of a context. */
+void QSPC_delete_regions(struct QSPC_context *context)
+{
+	free(context->regions->list);
+	free(context->regions);
+}
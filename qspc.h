@@ -1,12 +1,11 @@
 
-/* Largest number of cached parameters allowed at any given time. */
-#define QSPC_JOB_QUEUE_MAX 10
+/* The number of threads to use, or 0 for one for each CPU the process may
+ * run on. */
+#define QSPC_NUM_THREADS 0
 
-/* Number of parameters to cache per thread. */
-#define QSPC_JOB_CACHE_SIZE 10
-
-/* The number of threads to use. */
-#define QSPC_NUM_THREADS 4
+/* The number of roots a thread claims at once. Roots are small, and this
+ * keeps the threads from all adding to the same counter for each one. */
+#define QSPC_CLAIM_SIZE 8
 
 /* Maximum values that the coefficients of the powers on q-series can take. */
 #define QSPC_MAX_POWER_DEG_1 4
@@ -21,8 +20,10 @@
 #define QSPC_MAX_DIL_2 3
 
 /* The maximum number of q-Pochhammer symbols to allow on the numerator or
- * denominator of a q-series. */
-#define QSPC_MAX_NUM_QPS 1
+ * denominator of a q-series. This fixes the layout of the parameters below,
+ * and the number actually searched can be anything up to it. */
+#define QSPC_MAX_NUM_QPS 2
+#define QSPC_NUM_QPS 1
 
 /* The parameters for a particular q-series are encoded in an array of
  * integers with this length. The first 4 * QSPC_MAX_NUM_QPS entries
@@ -42,13 +43,220 @@
  *                               and otherwise set to 1. */
 #define QSPC_PARAMETER_LENGTH (8 * QSPC_MAX_NUM_QPS + 4)
 
+/* The search is split into subtrees for every choice of parameters before
+ * this index, and each subtree below it is searched by a single thread. */
+#define QSPC_SPLIT_DEPTH (QSPC_PARAMETER_LENGTH - 4)
+
 /* The number of terms to compute for each q-series. Larger values are likely
  * to result in integer overflow without using a big integer library. */
 #define QSPC_COEFFICIENT_BOUND 100
 
+/* The arithmetic used to compute the coefficients of each q-series and its
+ * factored form. Each combination starts with the chosen arithmetic and
+ * only moves on to the next if a coefficient overflows:
+ *   QSPC_ARITH_CHECKED   int64_t, checking every operation for overflow.
+ *   QSPC_ARITH_INT128    __int128, checking every operation for overflow.
+ *   QSPC_ARITH_MODULAR   Residues modulo QSPC_NUM_PRIMES primes, with the
+ *                        powers of the factored form found by the Chinese
+ *                        remainder theorem. These must fit in int64_t. */
+#define QSPC_ARITH_CHECKED 0
+#define QSPC_ARITH_INT128 1
+#define QSPC_ARITH_MODULAR 2
+#define QSPC_ARITHMETIC QSPC_ARITH_CHECKED
+
+/* The number of primes to use for modular arithmetic. All but the last
+ * are used to reconstruct values, and the last checks the result. The
+ * reconstruction is only exact for powers of less than half the product of
+ * all but the last prime, about 5 * 10^17 with the default ones, and nothing
+ * bounds the powers of a series in advance. A larger power is rebuilt as a
+ * wrong value that agrees with it modulo those primes, which the check
+ * rejects unless the two also agree modulo the last prime, with a chance of
+ * about 1 in 5 * 10^8. So the powers found this way are only exact with
+ * high probability, and an identity found from a wrong one is only ruled
+ * out when QSPC_VERIFY_BOUND checks it again. */
+#define QSPC_NUM_PRIMES 3
+
+/* Before any exact arithmetic, each combination is screened by factoring
+ * this many coefficients of its series modulo QSPC_SCREEN_PRIME. Longer
+ * prefixes throw out more combinations but cost more, and nothing is thrown
+ * out unless this is more than QSPC_PREPERIOD + QSPC_PATTERN_BOUND
+ * + QSPC_MAX_EXCEPTIONS + 1, so a context raises a shorter bound. Set to 0
+ * to skip the screening. */
+#define QSPC_SCREEN_BOUND 24
+#define QSPC_SCREEN_PRIME 998244353
+
+/* The number of combinations screened together, one in each lane of the
+ * vectorized arithmetic. These share their q-Pochhammer symbols, of which
+ * there are usually a few dozen. Must be even. */
+#define QSPC_SCREEN_LANES 16
+
+/* Each identity the search finds is checked again by a separate pool of
+ * QSPC_VERIFY_THREADS threads, which expand both of its sides to this many
+ * coefficients modulo the first QSPC_VERIFY_PRIMES of the primes. It is
+ * only reported if they agree. Set to at most QSPC_COEFFICIENT_BOUND to
+ * report identities as they are found. */
+#define QSPC_VERIFY_BOUND 2000
+#define QSPC_VERIFY_THREADS 1
+#define QSPC_VERIFY_PRIMES 2
+
+/* The number of entries in the shared cache of series summands. Each entry
+ * holds every summand for one choice of q-Pochhammer symbols, which takes
+ * more memory the larger the coefficient bound, so fewer entries are used
+ * once they would take more than QSPC_SERIES_CACHE_BYTES in all. */
+#define QSPC_SERIES_CACHE_SIZE 1024
+#define QSPC_SERIES_CACHE_BYTES (64 << 20)
+
+/* The size in bytes of the first block of scratch space each thread takes
+ * for its series. Any further blocks double in size, and are only taken if
+ * the bound needs them. */
+#define QSPC_ARENA_SIZE (1 << 20)
+
+/* The number of series whose factoring outcome is remembered, and the number
+ * of separately locked shards these are split between. Both must be powers
+ * of 2, with at least as many series as shards. */
+#define QSPC_MEMO_SIZE 16384
+#define QSPC_MEMO_SHARDS 64
+
 /* The largest pattern length to check for in a factored q-series.*/
 #define QSPC_PATTERN_BOUND 20
 
+/* The largest value the pattern bound can be set to at runtime, which fixes
+ * the size of the records identities are passed around in. */
+#define QSPC_MAX_PATTERN_BOUND 256
+
+/* The powers of a factored q-series may still be taken to have a pattern if
+ * the first QSPC_PREPERIOD of them do not follow it, and if at most
+ * QSPC_MAX_EXCEPTIONS of the others do not. Each such power is given as an
+ * exception alongside the pattern. */
+#define QSPC_PREPERIOD 0
+#define QSPC_MAX_EXCEPTIONS 0
+
+/* The largest value the preperiod and the number of exceptions can add up
+ * to at runtime. */
+#define QSPC_EXCEPTION_LIMIT 16
+
+/* The length of the largest signature of a product: the pattern, followed by
+ * the index and the power of each exception to it. */
+#define QSPC_MAX_SIGNATURE (QSPC_MAX_PATTERN_BOUND + 2 * QSPC_EXCEPTION_LIMIT)
+
+/* The number of identities that can wait to be written out at once. Must be
+ * a power of 2. */
+#define QSPC_RESULT_QUEUE_SIZE 1024
+
+/* The number of distinct identities that can be told apart from each other
+ * when grouping equivalent ones. Must be a power of 2. */
+#define QSPC_GROUP_TABLE_SIZE 65536
+
+/* The number of seconds between checkpoints, when they are enabled. */
+#define QSPC_CHECKPOINT_INTERVAL 60
+
+/* The number of seconds between progress reports on stderr, or 0 for none. */
+#define QSPC_PROGRESS_INTERVAL 10
+
+/* The counters each worker thread keeps on its part of the search, and the
+ * verification threads on theirs. The times are in nanoseconds. */
+enum QSPC_counter
+{
+	QSPC_COUNT_COMBINATIONS,	/* Combinations tried */
+	QSPC_COUNT_SCREEN_PASSED,	/* Passed by the screening */
+	QSPC_COUNT_NO_POWERS,		/* Powers not found exactly */
+	QSPC_COUNT_NO_PATTERN,		/* Powers without a pattern */
+	QSPC_COUNT_DILATED,		/* Patterns of a dilated identity */
+	QSPC_COUNT_PRUNED_DILATED,	/* Combinations dilating another */
+	QSPC_COUNT_IDENTITIES,		/* Identities found */
+	QSPC_COUNT_VERIFIED,		/* Identities verified */
+	QSPC_COUNT_VERIFY_FAILED,	/* Identities failing verification */
+	QSPC_COUNT_MEMO_HITS,		/* Series factored before */
+	QSPC_COUNT_MEMO_MISSES,		/* Series factored for the first time */
+	QSPC_COUNT_ROOTS,		/* Roots searched */
+	QSPC_COUNT_ROOTS_SKIPPED,	/* Roots finished before resuming */
+	QSPC_COUNT_ROOTS_REUSED,	/* Roots searched in an earlier run */
+	QSPC_COUNT_REUSED,		/* Combinations searched earlier */
+	QSPC_COUNT_POWERS_TIME,		/* Finding powers */
+	QSPC_COUNT_PATTERN_TIME,	/* Finding patterns */
+	QSPC_COUNT_VERIFY_TIME,		/* Verifying identities */
+	QSPC_COUNT_IDLE_TIME,		/* Waiting for the last roots */
+	QSPC_COUNT_TOTAL_TIME,		/* Running at all */
+	QSPC_NUM_COUNTERS
+};
+
+/* The search settings that can be changed at runtime, with the option that
+ * sets each. They default to the definitions above, and only the layout of
+ * the parameters stays fixed at compile time. The library only reads the
+ * settings up to the CPUs to pin to, and the shard. */
+struct QSPC_config
+{
+	int64_t num_threads;		/* --threads */
+	int64_t max_power_deg_1;	/* --power-deg-1 */
+	int64_t max_power_deg_2;	/* --power-deg-2 */
+	int64_t max_fac_deg_0;		/* --fac-deg-0 */
+	int64_t max_fac_deg_1;		/* --fac-deg-1 */
+	int64_t max_dil_1;		/* --dil-1 */
+	int64_t max_dil_2;		/* --dil-2 */
+	int64_t num_qps;		/* --num-qps */
+	int64_t coefficient_bound;	/* --bound */
+	int64_t pattern_bound;		/* --pattern-bound */
+	int64_t preperiod;		/* --preperiod */
+	int64_t max_exceptions;		/* --exceptions */
+	int64_t screen_bound;		/* --screen-bound */
+	int64_t verify_bound;		/* --verify-bound */
+	int64_t verify_threads;		/* --verify-threads */
+	const char *cpu_list;		/* --cpus, or NULL to not pin */
+	int64_t checkpoint_interval;	/* --checkpoint-interval */
+	int64_t progress_interval;	/* --progress-interval */
+	const char *checkpoint_path;	/* --checkpoint */
+	const char *database_path;	/* --database */
+	bool resume;			/* --resume */
+	int64_t shard_index;		/* --shard, as i in i/N */
+	int64_t shard_count;		/* --shard, as N in i/N */
+	int64_t num_merge_paths;	/* --merge, the files to merge */
+	char **merge_paths;
+	const char *render_path;	/* --render */
+};
+
+/* Everything the series engine and the search work with, so that any number
+ * of them with different settings can be used at once in one process. Each
+ * part is laid out by the file that owns it. The caches can be shared by
+ * any number of threads, but only one search runs on a context at a time.
+ * Made by QSPC_create_context. */
+struct QSPC_context
+{
+	struct QSPC_config config;
+	struct QSPC_divisors *divisors;		/* numbers.c */
+	struct QSPC_algebra *algebra;		/* algebra.c */
+	struct QSPC_memo *memo;			/* memo.c */
+	struct QSPC_search *search;		/* threads.c */
+	struct QSPC_verify *verify;		/* verify.c */
+	struct QSPC_topology *topology;		/* topology.c */
+	struct QSPC_regions *regions;		/* prune.c */
+};
+
+/* What a search reports back to the program running it. Any of the
+ * functions can be NULL, and each is passed data. */
+struct QSPC_search_hooks
+{
+	void *data;
+
+	/* Called for each identity found, in the root with the given
+	 * number, once it has been verified to the given number of
+	 * coefficients. */
+	void (*identity)(void *data, int64_t root, int64_t *parameters,
+			 int64_t *signature, int64_t period,
+			 int64_t exceptions, int64_t verified);
+
+	/* Returns true for a root that was searched before, which is then
+	 * skipped. */
+	bool (*root_finished)(void *data, int64_t root);
+
+	/* Called once every identity in a root has been reported. */
+	void (*finish_root)(void *data, int64_t root);
+
+	/* Called once the workers are running, and once they have all
+	 * stopped. */
+	void (*start)(void *data);
+	void (*stop)(void *data);
+};
+
 /* Returns the number of q-Pochhammer symbols in the numerator of a q-series.
  *  parameters: The parameters that encode the series. */
 static inline int64_t QSPC_num_qps(int64_t *parameters)
@@ -81,3 +289,64 @@ static inline int64_t QSPC_den_qps(int64_t *parameters)
 	return length;
 }
 
+
+/* Returns the power of q in front of a particular summand of a q-series.
+ *   parameters: The parameters that encode the series.
+ *   summation_index: The index of the summand. */
+static inline int64_t QSPC_series_offset(int64_t *parameters,
+					 int64_t summation_index)
+{
+	return (parameters[QSPC_PARAMETER_LENGTH - 4] * summation_index
+		* summation_index + parameters[QSPC_PARAMETER_LENGTH - 3]
+		* summation_index) / parameters[QSPC_PARAMETER_LENGTH - 2];
+}
+
+/* Returns the sign in front of a particular summand of a q-series.
+ *   parameters: The parameters that encode the series.
+ *   summation_index: The index of the summand. */
+static inline int64_t QSPC_series_sign(int64_t *parameters,
+				       int64_t summation_index)
+{
+	if (parameters[QSPC_PARAMETER_LENGTH - 1] == -1
+	    && (summation_index % 2) == 1) return -1;
+
+	return 1;
+}
+
+/* The library interface, which is all a program needs to build, factor and
+ * search for series. Every thread that calls into it should call
+ * QSPC_delete_arena before it exits. */
+extern const struct QSPC_config QSPC_default_config;
+
+const char *QSPC_check_config(const struct QSPC_config *config);
+struct QSPC_context *QSPC_create_context(const struct QSPC_config *config);
+void QSPC_delete_context(struct QSPC_context *context);
+void QSPC_delete_arena(void);
+
+bool QSPC_build_series(struct QSPC_context *context, int64_t *parameters,
+		       int64_t *result, int64_t bound);
+int64_t QSPC_find_product_form(struct QSPC_context *context,
+			       int64_t *series, int64_t *powers,
+			       int64_t bound);
+int64_t QSPC_find_pattern(struct QSPC_context *context, int64_t *powers,
+			  int64_t *pattern, int64_t *exceptions);
+bool QSPC_verify_identity(int64_t *parameters, int64_t *signature,
+			  int64_t period, int64_t exceptions, int64_t bound);
+int64_t QSPC_verified_bound(const struct QSPC_config *config);
+bool QSPC_in_region(const struct QSPC_config *region, int64_t *parameters);
+bool QSPC_add_searched_region(struct QSPC_context *context,
+			      const struct QSPC_config *region);
+
+int64_t QSPC_count_roots(struct QSPC_context *context);
+int64_t QSPC_rank_root(struct QSPC_context *context, int64_t *parameters);
+void QSPC_unrank_root(struct QSPC_context *context, int64_t root,
+		      int64_t *parameters);
+void QSPC_run_search(struct QSPC_context *context,
+		     const struct QSPC_search_hooks *hooks, int64_t *counters);
+void QSPC_collect_counters(struct QSPC_context *context, int64_t *counters);
+void QSPC_series_cache_stats(struct QSPC_context *context, int64_t *hits,
+			     int64_t *misses);
+void QSPC_arithmetic_stats(struct QSPC_context *context, int64_t *wide,
+			   int64_t *modular, int64_t *failed,
+			   int64_t *mismatched);
+int64_t QSPC_time_ns(void);
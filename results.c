@@ -0,0 +1,456 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "qspc.h"
+
+extern void QSPC_report_identity(int64_t *, int64_t, int64_t *, int64_t,
+				 int64_t);
+extern void QSPC_print_header(void);
+extern void QSPC_print_footer(void);
+extern int64_t QSPC_find_group(int64_t *, int64_t, int64_t, bool *);
+extern void QSPC_keep_identity(int64_t *, int64_t *, int64_t, int64_t);
+
+extern struct QSPC_config QSPC_config;
+
+/* Identities are handed from the worker threads to a single writer thread
+ * through a bounded queue, so that finding one never waits on stdout. Each
+ * is written out as a line of JSON, and --render turns these lines into the
+ * LaTeX file afterwards. Each line also gives the group of identities
+ * with the same product that it belongs to. */
+
+/* An identity waiting to be written out. */
+struct QSPC_result
+{
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t period;
+	int64_t exceptions;
+	int64_t signature[QSPC_MAX_SIGNATURE];
+	int64_t verified;
+	int64_t group;
+	bool first;
+};
+
+/* A slot of the queue. Its sequence number says whether the slot is free to
+ * fill for a given position, or holds the result for that position. */
+struct result_slot
+{
+	atomic_int_fast64_t sequence;
+	struct QSPC_result result;
+};
+
+/* The queue is a ring buffer in the style of Vyukov's bounded queue. Any
+ * thread can claim the next position to fill, and only the writer thread
+ * takes results out, so it needs no atomics for its own position. */
+static struct result_slot result_queue[QSPC_RESULT_QUEUE_SIZE];
+static _Alignas(64) atomic_int_fast64_t result_head;
+static _Alignas(64) int64_t result_tail;
+
+/* The writer thread waits on this condition variable when the queue is
+ * empty, and is stopped by setting result_stop. */
+static pthread_t result_thread;
+static FILE *result_stream;
+static atomic_bool result_waiting;
+static bool result_stop;
+static pthread_mutex_t result_lock;
+static pthread_cond_t result_cond;
+
+/* Writes one identity as a line of JSON, after finding the group it belongs
+ * to. Groups are found here rather than as identities are submitted, so
+ * that they are numbered in the order they are written out. */
+static void write_result(struct QSPC_result *result)
+{
+	result->group = QSPC_find_group(result->signature, result->period,
+					result->exceptions, &result->first);
+
+	fprintf(result_stream, "{\"parameters\": [");
+
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index) {
+		fprintf(result_stream, index == 0 ? "%lld" : ", %lld",
+			(long long)result->parameters[index]);
+	}
+
+	fprintf(result_stream, "], \"period\": %lld, \"signature\": [",
+		(long long)result->period);
+
+	for (int64_t index = 0; index < result->period; ++index) {
+		fprintf(result_stream, index == 0 ? "%lld" : ", %lld",
+			(long long)result->signature[index]);
+	}
+
+	/* Exceptions are given as the index and the power of each in turn,
+	 * and left out when there are none. */
+	if (result->exceptions > 0) {
+		fprintf(result_stream, "], \"exceptions\": [");
+
+		for (int64_t index = 0; index < 2 * result->exceptions;
+		     ++index) {
+			fprintf(result_stream, index == 0 ? "%lld" : ", %lld",
+				(long long)result->signature[result->period
+							     + index]);
+		}
+	}
+
+	fprintf(result_stream, "], \"verified\": %lld, \"group\": %lld}\n",
+		(long long)result->verified, (long long)result->group);
+}
+
+/* Entry point for the writer thread. */
+static void *result_main(void *argument)
+{
+	(void)argument;
+
+	for (;;) {
+		struct result_slot *slot = &result_queue[result_tail
+			& (QSPC_RESULT_QUEUE_SIZE - 1)];
+
+		if (atomic_load_explicit(&slot->sequence, memory_order_acquire)
+		    == result_tail + 1) {
+			write_result(&slot->result);
+			atomic_store_explicit(&slot->sequence, result_tail
+					      + QSPC_RESULT_QUEUE_SIZE,
+					      memory_order_release);
+			++result_tail;
+			continue;
+		}
+
+		/* The queue is empty, so this is a good time to flush. */
+		fflush(result_stream);
+
+		pthread_mutex_lock(&result_lock);
+		atomic_store(&result_waiting, true);
+
+		/* Pairs with QSPC_submit_result, so that either the result
+		 * is seen here or the waiting flag is seen there. */
+		while (!result_stop && atomic_load(&slot->sequence)
+		       != result_tail + 1)
+			pthread_cond_wait(&result_cond, &result_lock);
+
+		atomic_store(&result_waiting, false);
+
+		/* Every result is in before the thread is told to stop. */
+		if (result_stop && atomic_load(&slot->sequence)
+		    != result_tail + 1) {
+			pthread_mutex_unlock(&result_lock);
+			return NULL;
+		}
+
+		pthread_mutex_unlock(&result_lock);
+	}
+}
+
+/* Starts the thread that writes out identities.
+ *   stream: Where the identities are written, which is normally stdout. */
+void QSPC_start_results(FILE *stream)
+{
+	result_stream = stream;
+
+	for (int64_t index = 0; index < QSPC_RESULT_QUEUE_SIZE; ++index)
+		atomic_init(&result_queue[index].sequence, index);
+
+	atomic_init(&result_head, 0);
+	atomic_init(&result_waiting, false);
+	result_tail = 0;
+	result_stop = false;
+	pthread_mutex_init(&result_lock, NULL);
+	pthread_cond_init(&result_cond, NULL);
+	pthread_create(&result_thread, NULL, result_main, NULL);
+}
+
+/* Writes out every identity still in the queue, and stops the writer
+ * thread. No more identities can be submitted once this is called. */
+void QSPC_stop_results(void)
+{
+	pthread_mutex_lock(&result_lock);
+	result_stop = true;
+	pthread_cond_signal(&result_cond);
+	pthread_mutex_unlock(&result_lock);
+	pthread_join(result_thread, NULL);
+
+	fflush(result_stream);
+	pthread_mutex_destroy(&result_lock);
+	pthread_cond_destroy(&result_cond);
+}
+
+/* Queues an identity to be written out. This only waits if the queue is
+ * full, which takes a very large number of identities found at once.
+ *   parameters: The series parameters.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions.
+ *   verified: The number of coefficients the identity was checked to. */
+void QSPC_submit_result(int64_t *parameters, int64_t *signature,
+			int64_t period, int64_t exceptions, int64_t verified)
+{
+	int64_t position = atomic_load_explicit(&result_head,
+						memory_order_relaxed);
+	struct result_slot *slot;
+
+	QSPC_keep_identity(parameters, signature, period, exceptions);
+
+	for (;;) {
+		int64_t sequence;
+
+		slot = &result_queue[position & (QSPC_RESULT_QUEUE_SIZE - 1)];
+		sequence = atomic_load_explicit(&slot->sequence,
+						memory_order_acquire);
+
+		if (sequence == position) {
+			if (atomic_compare_exchange_weak_explicit(&result_head,
+			    &position, position + 1, memory_order_relaxed,
+			    memory_order_relaxed)) break;
+		} else {
+			/* Either another thread claimed this position, or
+			 * the queue is full and the writer needs to catch
+			 * up. */
+			if (sequence < position) sched_yield();
+
+			position = atomic_load_explicit(&result_head,
+							memory_order_relaxed);
+		}
+	}
+
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+		slot->result.parameters[index] = parameters[index];
+
+	for (int64_t index = 0; index < period + 2 * exceptions; ++index)
+		slot->result.signature[index] = signature[index];
+
+	slot->result.period = period;
+	slot->result.exceptions = exceptions;
+	slot->result.verified = verified;
+	atomic_store_explicit(&slot->sequence, position + 1,
+			      memory_order_release);
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	if (atomic_load_explicit(&result_waiting, memory_order_relaxed)) {
+		pthread_mutex_lock(&result_lock);
+		pthread_cond_signal(&result_cond);
+		pthread_mutex_unlock(&result_lock);
+	}
+}
+
+/* Helper function for read_result. Reads the array of integers following a
+ * key in a line of JSON. Returns the number of integers, or -1 if the key
+ * is missing or there are more than the given maximum.
+ *   line: The line of JSON.
+ *   key: The key, including its quotes.
+ *   values: Where the integers are written.
+ *   maximum: The length of this array. */
+static int64_t read_array(const char *line, const char *key,
+			  int64_t *values, int64_t maximum)
+{
+	const char *position = strstr(line, key);
+	int64_t length = 0;
+
+	if (position == NULL) return -1;
+
+	position = strchr(position + strlen(key), '[');
+
+	if (position == NULL) return -1;
+
+	for (++position;;) {
+		char *end;
+
+		while (*position == ' ') ++position;
+
+		if (*position == ']') return length;
+
+		if (length == maximum) return -1;
+
+		errno = 0;
+		values[length++] = strtoll(position, &end, 10);
+
+		if (end == position || errno != 0) return -1;
+
+		position = end;
+
+		while (*position == ' ') ++position;
+
+		if (*position == ',') {
+			++position;
+		} else if (*position != ']') {
+			return -1;
+		}
+	}
+}
+
+/* Helper function for QSPC_render_results. Reads an identity from a line
+ * written by write_result. Lines that only give the parameters and the
+ * group, as earlier versions wrote for all but the first of each group, are
+ * also read. Lines without a group, which are from before identities were
+ * grouped, are put in a group of their own. Returns false if the line is
+ * not valid.
+ *   line: The line of JSON.
+ *   line_number: The number of the line, for ordering the groups.
+ *   result: Where the identity is written. */
+static bool read_result(const char *line, int64_t line_number,
+			struct QSPC_result *result)
+{
+	const char *period = strstr(line, "\"period\":");
+	const char *group = strstr(line, "\"group\":");
+	long long value;
+
+	if (read_array(line, "\"parameters\":", result->parameters,
+		       QSPC_PARAMETER_LENGTH) != QSPC_PARAMETER_LENGTH)
+		return false;
+
+	if (group == NULL) {
+		result->group = INT64_MIN + line_number;
+	} else if (sscanf(group + strlen("\"group\":"), "%lld", &value) == 1
+		   && value >= 0) {
+		result->group = value;
+	} else {
+		return false;
+	}
+
+	result->first = period != NULL;
+
+	if (!result->first) return group != NULL;
+
+	result->period = read_array(line, "\"signature\":", result->signature,
+				    QSPC_MAX_PATTERN_BOUND);
+
+	if (result->period <= 0
+	    || sscanf(period + strlen("\"period\":"), "%lld", &value) != 1
+	    || value != result->period) return false;
+
+	/* Only identities with exceptions have any to read. */
+	if (strstr(line, "\"exceptions\":") == NULL) {
+		result->exceptions = 0;
+		return true;
+	}
+
+	result->exceptions = read_array(line, "\"exceptions\":",
+					&result->signature[result->period],
+					2 * QSPC_EXCEPTION_LIMIT);
+
+	if (result->exceptions < 0 || result->exceptions % 2 != 0)
+		return false;
+
+	result->exceptions /= 2;
+
+	return true;
+}
+
+/* An identity read back in, with the line it was on. */
+struct render_entry
+{
+	int64_t line_number;
+	struct QSPC_result result;
+};
+
+/* Orders identities by group, keeping the order they were read in within
+ * each group. */
+static int compare_results(const void *pointer1, const void *pointer2)
+{
+	const struct render_entry *entry1 = pointer1;
+	const struct render_entry *entry2 = pointer2;
+
+	if (entry1->result.group != entry2->result.group)
+		return entry1->result.group < entry2->result.group ? -1 : 1;
+
+	return (entry1->line_number > entry2->line_number)
+	       - (entry1->line_number < entry2->line_number);
+}
+
+/* Prints identities written out by a search as a LaTeX file, with every sum
+ * in a group given as equal to the same product. Returns false and prints a
+ * message if the file cannot be read or a line is not valid.
+ *   path: The file the search wrote, or - for stdin. */
+bool QSPC_render_results(const char *path)
+{
+	FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	struct render_entry *results = NULL;
+	int64_t num_results = 0;
+	int64_t *sums;
+	int64_t capacity = 0;
+	char line[4096];
+	int64_t line_number = 0;
+	bool success = true;
+
+	if (file == NULL) {
+		fprintf(stderr, "qspc: cannot open %s: %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	/* Every identity has to be read before any group is complete. */
+	while (fgets(line, sizeof(line), file) != NULL) {
+		++line_number;
+
+		if (strspn(line, " \t\r\n") == strlen(line)) continue;
+
+		if (num_results == capacity) {
+			capacity = capacity == 0 ? 64 : 2 * capacity;
+			results = realloc(results, (size_t)capacity
+					  * sizeof(struct render_entry));
+		}
+
+		results[num_results].line_number = line_number;
+
+		if (!read_result(line, line_number,
+				 &results[num_results].result)) {
+			fprintf(stderr, "qspc: %s:%lld: not an identity\n",
+				path, (long long)line_number);
+			success = false;
+			continue;
+		}
+
+		++num_results;
+	}
+
+	if (file != stdin) fclose(file);
+
+	qsort(results, (size_t)num_results, sizeof(struct render_entry),
+	      compare_results);
+
+	/* A group can hold every result, and groups can be large, so the sums
+	 * of each are gathered on the heap. */
+	sums = malloc((size_t)(num_results * QSPC_PARAMETER_LENGTH)
+		      * sizeof(int64_t));
+
+	QSPC_print_header();
+
+	for (int64_t start = 0, end; start < num_results; start = end) {
+		struct QSPC_result *product = NULL;
+
+		for (end = start; end < num_results && results[end].result.group
+		     == results[start].result.group; ++end) {
+			if (results[end].result.first && product == NULL)
+				product = &results[end].result;
+		}
+
+		if (product == NULL) {
+			fprintf(stderr, "qspc: %s: group %lld has no product\n",
+				path, (long long)results[start].result.group);
+			success = false;
+			continue;
+		}
+
+		for (int64_t index = start; index < end; ++index) {
+			for (int64_t offset = 0; offset < QSPC_PARAMETER_LENGTH;
+			     ++offset) {
+				sums[(index - start) * QSPC_PARAMETER_LENGTH
+				     + offset] = results[index].result
+						 .parameters[offset];
+			}
+		}
+
+		QSPC_report_identity(sums, end - start, product->signature,
+				     product->period, product->exceptions);
+	}
+
+	QSPC_print_footer();
+	free(sums);
+	free(results);
+
+	return success;
+}
@@ -1,324 +1,655 @@
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include "qspc.h"
 
-extern void QSPC_report_identity(int64_t *, int64_t *, int64_t);
-extern int64_t QSPC_find_pattern(int64_t *, int64_t *);
-extern void QSPC_find_product_form(int64_t *, int64_t *, int64_t);
-extern void QSPC_build_series(int64_t *, int64_t *, int64_t);
-extern int64_t QSPC_pattern_gcd(int64_t *, int64_t);
-extern void QSPC_generate_divisors(void);
-extern void QSPC_delete_divisors(void);
+struct QSPC_root_hold;
+
+extern void QSPC_screen_batch(struct QSPC_context *,
+			      int64_t (*)[QSPC_PARAMETER_LENGTH], int64_t,
+			      bool *);
+extern bool QSPC_series_powers(struct QSPC_context *, int64_t *, int64_t *,
+			       int64_t *, int64_t);
+extern void QSPC_memo_key(int64_t *, int64_t, uint64_t *);
+extern bool QSPC_memo_find(struct QSPC_context *, uint64_t *, int64_t *,
+			   int64_t *, int64_t *);
+extern void QSPC_memo_store(struct QSPC_context *, uint64_t *, int64_t,
+			    int64_t *, int64_t);
+extern int64_t QSPC_pattern_gcd(int64_t *, int64_t, int64_t);
+extern int64_t QSPC_arena_mark(void);
+extern void *QSPC_arena_alloc(int64_t);
+extern void QSPC_arena_release(int64_t);
+extern int64_t QSPC_dilation(int64_t *);
+extern bool QSPC_region_searched(struct QSPC_context *, int64_t *, int64_t);
+extern void QSPC_start_verify(struct QSPC_context *,
+			      const struct QSPC_search_hooks *);
+extern void QSPC_stop_verify(struct QSPC_context *);
+extern void QSPC_submit_identity(struct QSPC_context *,
+				 struct QSPC_root_hold **, int64_t, int64_t *,
+				 int64_t *, int64_t, int64_t);
+extern void QSPC_release_root(struct QSPC_context *, struct QSPC_root_hold *,
+			      int64_t);
+extern void QSPC_add_verify_counters(struct QSPC_context *, int64_t *);
+extern void QSPC_pin_thread(struct QSPC_context *, int64_t);
+
+/* Returns the time from a monotonic clock in nanoseconds. */
+int64_t QSPC_time_ns(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (int64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
 
-extern pthread_mutex_t QSPC_print_lock;
+/* The roots of a shard are numbered from 0 in the order a single thread
+ * would search them, leaving out those of other shards, and handed out to
+ * the workers by a single counter. A worker claims QSPC_CLAIM_SIZE roots at
+ * a time with one atomic add, and works out the parameters of each from its
+ * number, so no thread ever waits on another for work, and the roots claimed
+ * so far say exactly how far along the search is. */
 
-/* The main thread generates a (FILO) queue of parameters for the worker
- * threads to try. This takes the form of a linked list. */
-struct QSPC_job_entry
+/* The state of each worker thread. */
+struct QSPC_worker
 {
-	/* Number of parameter combinations. */
-	int64_t entries;
+	/* The context of the search, the number of the root being searched
+	 * and the hold on it while its identities are verified (verify.c). */
+	struct QSPC_context *context;
+	int64_t root;
+	struct QSPC_root_hold *hold;
 
-	/* Points to the next linked list entry. */
-	struct QSPC_job_entry *next;
+	/* When the worker found no roots left to claim. */
+	int64_t finished;
 
-	/* An array of parameter combinations. */
-	int64_t parameters[QSPC_JOB_CACHE_SIZE][QSPC_PARAMETER_LENGTH];
+	/* Only written by the owner, but read by the progress reports, so
+	 * they are atomic without needing any atomic operations. */
+	_Alignas(64) atomic_int_fast64_t counters[QSPC_NUM_COUNTERS];
+
+	pthread_t thread;
 };
 
-/* Points to the front of the queue. */
-static struct QSPC_job_entry *QSPC_job_queue;
+/* The state a context keeps for searching. */
+struct QSPC_search
+{
+	/* One for each of the threads of the search. */
+	struct QSPC_worker *workers;
+
+	/* The number of the next root of the shard to claim, which every
+	 * worker adds to, on a cache line of its own. */
+	_Alignas(64) atomic_int_fast64_t next_root;
+
+	/* What the search reports back to the program running it. */
+	_Alignas(64) const struct QSPC_search_hooks *hooks;
+
+	/* The number of roots that start with each choice of symbol, as laid
+	 * out by symbol_counts, and the number of ways to choose the symbols
+	 * of the numerator and the denominator, of the denominator alone,
+	 * and of neither. */
+	int64_t *root_counts;
+	int64_t side_roots[3];
+	int64_t symbols;
+	int64_t roots;
+};
 
-/* Number of elements in the queue. */
-static volatile int64_t QSPC_job_queue_length;
+/* Adds to one of the counters of a worker, which must be the calling
+ * thread. */
+static inline void add_count(struct QSPC_worker *worker,
+			     enum QSPC_counter counter, int64_t amount)
+{
+	atomic_store_explicit(&worker->counters[counter],
+			      atomic_load_explicit(&worker->counters[counter],
+						   memory_order_relaxed)
+			      + amount, memory_order_relaxed);
+}
+
+/* Helper function for try_combination. Generates the q-series and finds the
+ * pattern in the powers of its product form, unless the same series was
+ * factored before. Returns the length of the pattern, 0 if there is none,
+ * or -1 if the powers could not be found exactly.
+ *   worker: The worker thread trying the combination.
+ *   parameters: The series parameters.
+ *   pattern: Where the pattern is written, if there is one, followed by
+ *     its exceptions.
+ *   exceptions: Set to the number of exceptions to the pattern. */
+static int64_t find_period(struct QSPC_worker *worker, int64_t *parameters,
+			   int64_t *pattern, int64_t *exceptions)
+{
+	struct QSPC_context *context = worker->context;
+	int64_t bound = context->config.coefficient_bound;
+	int64_t mark = QSPC_arena_mark();
+	int64_t *series = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	int64_t *powers = QSPC_arena_alloc(bound * (int64_t)sizeof(int64_t));
+	uint64_t key[2];
+	int64_t period = -1;
+	int64_t start = QSPC_time_ns();
+	int64_t end;
+	bool built;
+
+	*exceptions = 0;
+
+	built = QSPC_build_series(context, parameters, series, bound);
+
+	/* Series that overflowed are not kept, since they have no exact
+	 * coefficients to key them by. */
+	if (built) {
+		QSPC_memo_key(series, bound, key);
+
+		if (QSPC_memo_find(context, key, &period, pattern,
+				   exceptions)) {
+			add_count(worker, QSPC_COUNT_MEMO_HITS, 1);
+			add_count(worker, QSPC_COUNT_POWERS_TIME,
+				  QSPC_time_ns() - start);
+			QSPC_arena_release(mark);
+			return period;
+		}
 
-/* Set to true on initialization, and then to false when the main thread is
- * finished generating parameter combinations, and is only waiting for the
- * worker threads to finish. */
-static volatile bool QSPC_keep_working;
+		add_count(worker, QSPC_COUNT_MEMO_MISSES, 1);
+	}
+
+	if (QSPC_series_powers(context, parameters, built ? series : NULL,
+			       powers, bound)) {
+		end = QSPC_time_ns();
+		period = QSPC_find_pattern(context, powers, pattern,
+					   exceptions);
+		add_count(worker, QSPC_COUNT_PATTERN_TIME,
+			  QSPC_time_ns() - end);
+	} else {
+		end = QSPC_time_ns();
+	}
 
-/* Used to make sure the main thread gets priority in acquiring the mutex.
- * Not the most efficient possible solution, but this is at least correct. */
-static volatile bool QSPC_yield_to_main;
+	add_count(worker, QSPC_COUNT_POWERS_TIME, end - start);
 
-/* Lock to modify the queue. */
-static pthread_mutex_t QSPC_job_lock;
+	if (built) QSPC_memo_store(context, key, period, pattern, *exceptions);
 
-/* Conditional variable for waking up the main thread. */
-static pthread_cond_t QSPC_generator_cond;
+	QSPC_arena_release(mark);
 
-/* Helper function for work_recursive_step. Adds a parameter combination to
- * the queue, handling the multithreading logic. */
-static void submit_parameters(int64_t *parameters)
+	return period;
+}
+
+/* Given a combination of parameters that passed the screening, this
+ * function generates the q-series and then attempts to factor it. If
+ * successful, the identity is reported to the program running the search.
+ *   worker: The worker thread trying the combination.
+ *   parameters: The series parameters. */
+static void try_combination(struct QSPC_worker *worker, int64_t *parameters)
 {
-	/* By design this pointer cannot be NULL. If this condition is met,
-	 * the element on the front of the queue is full. */
-	if (QSPC_job_queue->entries == QSPC_JOB_CACHE_SIZE) {
-		struct QSPC_job_entry *job;
-
-		/* If the queue is completely full, wait until it is emptied.
-		 * One of the worker threads will then signal to continue. */
-		if (QSPC_job_queue_length == QSPC_JOB_QUEUE_MAX) {
-			pthread_cond_wait(&QSPC_generator_cond,
-					  &QSPC_job_lock);
-			QSPC_yield_to_main = false;
-		}
+	int64_t buffer[QSPC_MAX_SIGNATURE];
+	int64_t period;
+	int64_t exceptions;
+
+	add_count(worker, QSPC_COUNT_SCREEN_PASSED, 1);
+	period = find_period(worker, parameters, buffer, &exceptions);
+
+	/* If the powers could not be found exactly, there is nothing that can
+	 * be trusted to check. */
+	if (period == -1) {
+		add_count(worker, QSPC_COUNT_NO_POWERS, 1);
+		return;
+	}
 
-		/* Prepend a new queue element. */
-		job = malloc(sizeof(struct QSPC_job_entry));
-		job->entries = 0;
-		job->next = QSPC_job_queue;
-		QSPC_job_queue = job;
-		++QSPC_job_queue_length;
+	if (period == 0) {
+		add_count(worker, QSPC_COUNT_NO_PATTERN, 1);
+		return;
 	}
 
-	/* Add the parameter combination to the element at the front of the
-	 * queue, which is guaranteed to exist and not be full here. */
-	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index) {
-		QSPC_job_queue->parameters[QSPC_job_queue->entries][index]
-			= parameters[index];
+	/* Throw out any dilated results since these are redundant. */
+	if (QSPC_pattern_gcd(buffer, period, exceptions) != 1) {
+		add_count(worker, QSPC_COUNT_DILATED, 1);
+		return;
 	}
 
-	++QSPC_job_queue->entries;
+	add_count(worker, QSPC_COUNT_IDENTITIES, 1);
+
+	QSPC_submit_identity(worker->context, &worker->hold, worker->root,
+			     parameters, buffer, period, exceptions);
 }
 
-/* Recursively generates all combinations of allowed series parameters, and
- * checks if they are candidates for identities.
- *   parameters: The series parameters, which are treated by the function as
- *     a list of loop indices.
- *   depth: Tracks the recursion depth. */
-static void work_recursive_step(int64_t *parameters, int64_t depth)
+/* Combinations of a root waiting to be screened together. These only
+ * differ in the power and the sign in front of the summands. */
+struct QSPC_batch
 {
-	int64_t offset;
-	bool first_step;
-
-	switch (depth) {
-
-	/* The furthest depth, where the combinations are finished. */
-	case QSPC_PARAMETER_LENGTH - 2:
-		parameters[QSPC_PARAMETER_LENGTH - 2] = 1;
-		parameters[QSPC_PARAMETER_LENGTH - 1] = 1;
-		submit_parameters(parameters);
-	
-		/* Try the same but with an alternating sign. */
-		parameters[QSPC_PARAMETER_LENGTH - 1] = -1;
-		submit_parameters(parameters);
-
-		/* If both power coefficients are odd, we can try to find an
-		 * identity with both of them divided by 2. */
-		if (parameters[QSPC_PARAMETER_LENGTH - 4] % 2 == 1 &&
-		    parameters[QSPC_PARAMETER_LENGTH - 3] % 2 == 1) {
-			parameters[QSPC_PARAMETER_LENGTH - 2] = 2;
-			parameters[QSPC_PARAMETER_LENGTH - 1] = 1;
-			submit_parameters(parameters);
-			parameters[QSPC_PARAMETER_LENGTH - 1] = -1;
-			submit_parameters(parameters);
-		}
+	int64_t parameters[QSPC_SCREEN_LANES][QSPC_PARAMETER_LENGTH];
+	int64_t count;
+};
 
-		return;
+/* Helper function for search_powers. Screens a batch of combinations, and
+ * tries those that pass in the order they were added, leaving the batch
+ * empty.
+ *   worker: The worker thread trying the combinations.
+ *   batch: The combinations. */
+static void try_batch(struct QSPC_worker *worker, struct QSPC_batch *batch)
+{
+	bool passed[QSPC_SCREEN_LANES];
 
-	case QSPC_PARAMETER_LENGTH - 3:
-		for (parameters[depth] = 0; parameters[depth]
-		     < QSPC_MAX_POWER_DEG_1; ++parameters[depth]) {
-			work_recursive_step(parameters, depth + 1);
-		}
+	add_count(worker, QSPC_COUNT_COMBINATIONS, batch->count);
+
+	/* Almost every combination can be thrown out without doing any exact
+	 * arithmetic. Only the rest are timed, which keeps the clock out of
+	 * the hot path. */
+	QSPC_screen_batch(worker->context, batch->parameters, batch->count,
+			  passed);
+
+	for (int64_t index = 0; index < batch->count; ++index) {
+		if (passed[index])
+			try_combination(worker, batch->parameters[index]);
+	}
+
+	batch->count = 0;
+}
 
+/* Helper function for search_powers. Adds a combination to the batch with
+ * and without an alternating sign, unless its series is a dilation of
+ * another, and tries the batch once it is full.
+ *   worker: The worker thread trying the combinations.
+ *   batch: The combinations waiting to be tried.
+ *   parameters: The series parameters, all chosen but the sign. */
+static void add_signs(struct QSPC_worker *worker, struct QSPC_batch *batch,
+		      int64_t *parameters)
+{
+	if (QSPC_dilation(parameters) != 1) {
+		add_count(worker, QSPC_COUNT_PRUNED_DILATED, 2);
 		return;
-	case QSPC_PARAMETER_LENGTH - 4:
-		for (parameters[depth] = 1; parameters[depth]
-		     < QSPC_MAX_POWER_DEG_2; ++parameters[depth]) {
-			work_recursive_step(parameters, depth + 1);
-		}
+	}
 
+	/* The identities of a run before are already written out. */
+	if (QSPC_region_searched(worker->context, parameters,
+				 QSPC_PARAMETER_LENGTH - 1)) {
+		add_count(worker, QSPC_COUNT_REUSED, 2);
 		return;
 	}
 
-	switch (depth % 4) {
-	case 0:
-		/* Here we take a number of arbitrary extra steps to reduce
-		 * the number of duplicate results. */
-		first_step = false;
+	for (int64_t sign = 1; sign >= -1; sign -= 2) {
+		int64_t *combination = batch->parameters[batch->count++];
 
-		if (depth < 4 * QSPC_MAX_NUM_QPS) {
-			offset = 0;
+		parameters[QSPC_PARAMETER_LENGTH - 1] = sign;
 
-			if (depth < 3) first_step = true;
-		} else {
-			offset = 4 * QSPC_MAX_NUM_QPS;
+		for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+			combination[index] = parameters[index];
+	}
+
+	if (batch->count == QSPC_SCREEN_LANES) try_batch(worker, batch);
+}
 
-			if (depth < 4 * QSPC_MAX_NUM_QPS + 3)
-				first_step = true;
+/* Helper function for search_root. Goes through every power in front of
+ * the summands of a root, whose symbols are all chosen.
+ *   worker: The worker thread doing the search.
+ *   parameters: The series parameters. */
+static void search_powers(struct QSPC_worker *worker, int64_t *parameters)
+{
+	struct QSPC_config *config = &worker->context->config;
+	struct QSPC_batch batch;
+
+	batch.count = 0;
+
+	for (parameters[QSPC_PARAMETER_LENGTH - 4] = 1;
+	     parameters[QSPC_PARAMETER_LENGTH - 4]
+	     < config->max_power_deg_2;
+	     ++parameters[QSPC_PARAMETER_LENGTH - 4]) {
+		for (parameters[QSPC_PARAMETER_LENGTH - 3] = 0;
+		     parameters[QSPC_PARAMETER_LENGTH - 3]
+		     < config->max_power_deg_1;
+		     ++parameters[QSPC_PARAMETER_LENGTH - 3]) {
+			parameters[QSPC_PARAMETER_LENGTH - 2] = 1;
+			add_signs(worker, &batch, parameters);
+
+			/* If both power coefficients are odd, we can try to
+			 * find an identity with both of them divided by 2. */
+			if (parameters[QSPC_PARAMETER_LENGTH - 4] % 2 == 1 &&
+			    parameters[QSPC_PARAMETER_LENGTH - 3] % 2 == 1) {
+				parameters[QSPC_PARAMETER_LENGTH - 2] = 2;
+				add_signs(worker, &batch, parameters);
+			}
 		}
+	}
 
-		/* If the degree 1 parameter on the subscript of the
-		 * q-Pochhammer symbol is 0, skip the rest of the
-		 * parameters since the whole symbol is taken to equal 1. */
-		parameters[depth] = 0;
-		work_recursive_step(parameters, offset + 4
-				    * QSPC_MAX_NUM_QPS);
+	if (batch.count > 0) try_batch(worker, &batch);
+}
+
+/* Returns the number of symbols the search can choose from, which are
+ * numbered by symbol_number. */
+static int64_t count_symbols(struct QSPC_config *config)
+{
+	return config->max_fac_deg_1 * (config->max_fac_deg_0 + 1)
+	       * config->max_dil_1 * config->max_dil_2;
+}
 
-		for (parameters[depth] = 1; parameters[depth]
-		     <= QSPC_MAX_FAC_DEG_1; ++parameters[depth]) {
+/* Returns the number of a symbol among those the search can choose from,
+ * which puts them in lexicographic order of their parameters.
+ *   config: The settings of the search.
+ *   symbol: The 4 parameters of the symbol, which must not be empty. */
+static int64_t symbol_number(struct QSPC_config *config, int64_t *symbol)
+{
+	return (((symbol[0] - 1) * (config->max_fac_deg_0 + 1) + symbol[1])
+		* config->max_dil_1 + symbol[2] - 1) * config->max_dil_2
+	       + symbol[3] - 1;
+}
 
-			/* Weakly order the q-Pochhammer symbols. */
-			if (!first_step && parameters[depth - 4] <
-			    parameters[depth]) return;
+/* Writes out the parameters of a symbol, undoing symbol_number. */
+static void number_symbol(struct QSPC_config *config, int64_t number,
+			  int64_t *symbol)
+{
+	symbol[3] = number % config->max_dil_2 + 1;
+	number /= config->max_dil_2;
+	symbol[2] = number % config->max_dil_1 + 1;
+	number /= config->max_dil_1;
+	symbol[1] = number % (config->max_fac_deg_0 + 1);
+	symbol[0] = number / (config->max_fac_deg_0 + 1) + 1;
+}
 
-			work_recursive_step(parameters, depth + 1);
-		}
+/* Returns the table of root counts for one of the symbols of the numerator
+ * or the denominator. Of the roots that share the symbols before it, entry s
+ * counts those with this symbol empty or numbered below s. So entry s + 1
+ * is also the number of ways to go on from the symbol before when that one
+ * is numbered s, and the entries never shrink.
+ *   search: The search state of a context.
+ *   side: 0 for the numerator and 1 for the denominator.
+ *   slot: The index of the symbol in its side.
+ *   num_qps: The number of symbols in each side. */
+static int64_t *symbol_counts(struct QSPC_search *search, int64_t side,
+			      int64_t slot, int64_t num_qps)
+{
+	return &search->root_counts[(side * num_qps + slot)
+				    * (search->symbols + 1)];
+}
 
-		break;
-	case 1:
-		for (parameters[depth] = 0; parameters[depth]
-		     <= QSPC_MAX_FAC_DEG_0; ++parameters[depth]) {
-			work_recursive_step(parameters, depth + 1);
+/* Sets up the search state of a context, filling in the tables of root
+ * counts from the last symbol back. Called when the context is created,
+ * after which the tables are only read. */
+void QSPC_create_search(struct QSPC_context *context)
+{
+	struct QSPC_search *search = aligned_alloc(_Alignof(struct QSPC_search),
+						   sizeof(struct QSPC_search));
+	int64_t num_qps = context->config.num_qps;
+	int64_t symbols = count_symbols(&context->config);
+
+	search->symbols = symbols;
+	search->root_counts = malloc((size_t)(2 * num_qps * (symbols + 1))
+				     * sizeof(int64_t));
+	search->side_roots[2] = 1;
+
+	for (int64_t side = 1; side >= 0; --side) {
+		int64_t after = search->side_roots[side + 1];
+
+		for (int64_t slot = num_qps - 1; slot >= 0; --slot) {
+			int64_t *counts = symbol_counts(search, side, slot,
+							num_qps);
+
+			/* Leaving the symbol empty leaves the rest of the
+			 * side empty too. Otherwise the next symbol is
+			 * numbered at most the same as this one. */
+			counts[0] = after;
+
+			for (int64_t number = 0; number < symbols; ++number) {
+				counts[number + 1] = counts[number]
+					+ (slot + 1 < num_qps ? symbol_counts(
+					search, side, slot + 1,
+					num_qps)[number + 1] : after);
+			}
 		}
 
-		break;
-	case 2:
-		for (parameters[depth] = 1; parameters[depth]
-		     <= QSPC_MAX_DIL_1; ++parameters[depth]) {
-			work_recursive_step(parameters, depth + 1);
+		search->side_roots[side] = num_qps > 0
+			? symbol_counts(search, side, 0, num_qps)[symbols]
+			: after;
+	}
+
+	search->roots = search->side_roots[0];
+	context->search = search;
+}
+
+/* Frees up the search state of a context. */
+void QSPC_delete_search(struct QSPC_context *context)
+{
+	free(context->search->root_counts);
+	free(context->search);
+}
+
+/* Returns the number of roots in the search of a context, across every
+ * shard. */
+int64_t QSPC_count_roots(struct QSPC_context *context)
+{
+	return context->search->roots;
+}
+
+/* Returns the number of a root, which is the number of roots a single
+ * thread would search before it, across every shard.
+ *   context: The context of the search.
+ *   parameters: The parameters that start the root. */
+int64_t QSPC_rank_root(struct QSPC_context *context, int64_t *parameters)
+{
+	struct QSPC_search *search = context->search;
+	int64_t num_qps = context->config.num_qps;
+	int64_t rank = 0;
+
+	for (int64_t side = 0; side < 2; ++side) {
+		for (int64_t slot = 0; slot < num_qps; ++slot) {
+			int64_t *symbol = &parameters[4 * QSPC_MAX_NUM_QPS
+						      * side + 4 * slot];
+
+			if (symbol[0] == 0) break;
+
+			rank += symbol_counts(search, side, slot, num_qps)
+				[symbol_number(&context->config, symbol)];
 		}
+	}
+
+	return rank;
+}
+
+/* Works out the parameters that start a root from its number, undoing
+ * QSPC_rank_root. Each symbol is either empty, which leaves the rest of the
+ * numerator or the denominator empty, or is at most the symbol before it in
+ * lexicographic order of its parameters, so that only one order of the
+ * symbols is ever searched, and the roots come in that order. At each
+ * symbol, the roots below the options before the right one are counted off.
+ *   context: The context of the search.
+ *   root: The number of the root, less than QSPC_count_roots.
+ *   parameters: Where the parameters are written, with the powers and the
+ *     sign left at 0. */
+void QSPC_unrank_root(struct QSPC_context *context, int64_t root,
+		      int64_t *parameters)
+{
+	struct QSPC_search *search = context->search;
+	int64_t num_qps = context->config.num_qps;
 
-		break;
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+		parameters[index] = 0;
 
-	case 3:
-		for (parameters[depth] = 1; parameters[depth]
-		     <= QSPC_MAX_DIL_2; ++parameters[depth]) {
-			work_recursive_step(parameters, depth + 1);
+	for (int64_t side = 0; side < 2; ++side) {
+		int64_t last = search->symbols - 1;
+
+		for (int64_t slot = 0; slot < num_qps; ++slot) {
+			int64_t *counts = symbol_counts(search, side, slot,
+							num_qps);
+			int64_t low = 0;
+			int64_t high = last;
+
+			if (root < counts[0]) break;
+
+			/* The last symbol numbered at most the one before
+			 * whose roots start at or before this one. */
+			while (low < high) {
+				int64_t middle = (low + high + 1) / 2;
+
+				if (counts[middle] <= root) low = middle;
+				else high = middle - 1;
+			}
+
+			root -= counts[low];
+			last = low;
+			number_symbol(&context->config, low,
+				      &parameters[4 * QSPC_MAX_NUM_QPS * side
+						  + 4 * slot]);
 		}
 	}
 }
 
-/* Given a combination of parameters, this function generates the q-series
- * and then attempts to factor it. If successful, the identity is printed. */
-static void try_combination(int64_t *parameters)
+/* Helper function for worker_thread. Searches a root, unless it was
+ * finished before the run was resumed, and then marks it finished.
+ *   worker: The worker thread doing the search.
+ *   root: The number of the root. */
+static void search_root(struct QSPC_worker *worker, int64_t root)
 {
-	int64_t buffer1[QSPC_COEFFICIENT_BOUND];
-	int64_t buffer2[QSPC_COEFFICIENT_BOUND];
-	int64_t buffer3[QSPC_PATTERN_BOUND];
-	int64_t period;
+	struct QSPC_context *context = worker->context;
+	const struct QSPC_search_hooks *hooks = context->search->hooks;
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
 
-	QSPC_build_series(parameters, buffer1, QSPC_COEFFICIENT_BOUND);
-	QSPC_find_product_form(buffer1, buffer2, QSPC_COEFFICIENT_BOUND);
-	period = QSPC_find_pattern(buffer2, buffer3);
+	if (hooks->root_finished != NULL
+	    && hooks->root_finished(hooks->data, root)) {
+		add_count(worker, QSPC_COUNT_ROOTS_SKIPPED, 1);
+		return;
+	}
 
-	if (period == 0) return;
+	QSPC_unrank_root(context, root, parameters);
 
-	/* Throw out any dilated results since these are redundant. */
-	if (QSPC_pattern_gcd(buffer3, period) != 1) return;
+	/* Roots searched in full by an earlier run are marked finished
+	 * without changing what a checkpoint holds. */
+	if (QSPC_region_searched(context, parameters, QSPC_SPLIT_DEPTH)) {
+		if (hooks->finish_root != NULL)
+			hooks->finish_root(hooks->data, root);
+
+		add_count(worker, QSPC_COUNT_ROOTS_REUSED, 1);
+		return;
+	}
 
-	QSPC_report_identity(parameters, buffer3, period);
+	worker->root = root;
+	worker->hold = NULL;
+	search_powers(worker, parameters);
+
+	/* The root is only finished once its identities are verified. */
+	QSPC_release_root(context, worker->hold, root);
+
+	add_count(worker, QSPC_COUNT_ROOTS, 1);
+}
+
+/* Returns the number of roots in the shard of a context. Roots are dealt
+ * out to the shards in turn, so each shard gets an even share of every part
+ * of the search, and neighbouring roots have similar costs. */
+static int64_t shard_roots(struct QSPC_context *context)
+{
+	int64_t shard = context->config.shard_index;
+	int64_t roots = context->search->roots;
+
+	return shard < roots ? (roots - shard - 1)
+	       / context->config.shard_count + 1 : 0;
 }
 
 /* Entry point for each worker thread. */
 static void *worker_thread(void *argument)
 {
-	struct QSPC_job_entry *job;
+	struct QSPC_worker *worker = argument;
+	struct QSPC_context *context = worker->context;
+	struct QSPC_search *search = context->search;
+	int64_t roots = shard_roots(context);
+	int64_t start = QSPC_time_ns();
 
-	(void)argument;
+	/* Before anything is allocated, so that it is local to the CPU. */
+	QSPC_pin_thread(context, worker - search->workers);
 
 	for (;;) {
-		pthread_mutex_lock(&QSPC_job_lock);
+		int64_t first = atomic_fetch_add_explicit(&search->next_root,
+							  QSPC_CLAIM_SIZE,
+							  memory_order_relaxed);
+
+		if (first >= roots) break;
 
-		/* If this condition is true, then main is waiting for the
-		 * mutex, and needs to have priority. */
-		if (QSPC_yield_to_main) {
-			pthread_mutex_unlock(&QSPC_job_lock);
-			continue;
+		for (int64_t index = first; index < first + QSPC_CLAIM_SIZE
+		     && index < roots; ++index) {
+			search_root(worker, index * context->config.shard_count
+				    + context->config.shard_index);
 		}
+	}
 
-		/* If this holds instead, the worker thread holding the mutex
-		 * is the first to discover the queue is empty. That is,
-		 * unless there is no more work to do. */
-		if (QSPC_job_queue_length == 0) {
-			if (!QSPC_keep_working) {
-				pthread_mutex_unlock(&QSPC_job_lock);
-				pthread_exit(NULL);
-			}
+	worker->finished = QSPC_time_ns();
+	add_count(worker, QSPC_COUNT_TOTAL_TIME, worker->finished - start);
+	QSPC_delete_arena();
 
-			/* If the queue is empty and QSPC_keep_working is true
-			 * then the main thread is waiting to be woken up. */
-			QSPC_yield_to_main = true;
-			pthread_mutex_unlock(&QSPC_job_lock);
-			pthread_cond_signal(&QSPC_generator_cond);
-			continue;
-		}
+	return NULL;
+}
 
-		/* Take a job off the queue. */
-		job = QSPC_job_queue;
-		QSPC_job_queue = QSPC_job_queue->next;
-		--QSPC_job_queue_length;
-		pthread_mutex_unlock(&QSPC_job_lock);
+/* Adds up the counters of every worker while the search of a context runs.
+ *   context: The context of the search.
+ *   counters: Where the QSPC_NUM_COUNTERS totals are written. */
+void QSPC_collect_counters(struct QSPC_context *context, int64_t *counters)
+{
+	for (int64_t counter = 0; counter < QSPC_NUM_COUNTERS; ++counter)
+		counters[counter] = 0;
 
-		/* Here the actual work is done. Check every combination. */
-		for (int64_t index = 0; index < job->entries; ++index) {
-			try_combination(job->parameters[index]);
-		}
+	for (int64_t index = 0; index < context->config.num_threads; ++index) {
+		struct QSPC_worker *worker = &context->search->workers[index];
 
-		free(job);
+		for (int64_t counter = 0; counter < QSPC_NUM_COUNTERS;
+		     ++counter) {
+			counters[counter] += atomic_load_explicit(
+				&worker->counters[counter],
+				memory_order_relaxed);
+		}
 	}
+
+	QSPC_add_verify_counters(context, counters);
 }
 
-int main(int argc, char **argv)
+/* Searches every combination of parameters in the shard of a context, with
+ * as many worker threads as its settings give. The program running the
+ * search is told what is found through the hooks, from the worker threads.
+ *   context: The context of the search.
+ *   hooks: What the search reports back to.
+ *   counters: Where the QSPC_NUM_COUNTERS totals over the workers are
+ *     written. */
+void QSPC_run_search(struct QSPC_context *context,
+		     const struct QSPC_search_hooks *hooks, int64_t *counters)
 {
-	pthread_t threads[QSPC_NUM_THREADS];
-	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	struct QSPC_search *search = context->search;
+	int64_t threads = context->config.num_threads;
+	int64_t end;
 
-	/* Prevent compiler warnings for unused variables. */
-	(void)argc;
-	(void)argv;
+	search->hooks = hooks;
+	search->workers = aligned_alloc(_Alignof(struct QSPC_worker),
+					(size_t)threads
+					* sizeof(struct QSPC_worker));
 
-	QSPC_keep_working = true;
-	QSPC_yield_to_main = false;
+	for (int64_t index = 0; index < threads; ++index) {
+		struct QSPC_worker *worker = &search->workers[index];
 
-	/* Create a permanent list of divisors for QSPC_find_product_form. */
-	QSPC_generate_divisors();
+		worker->context = context;
 
-	pthread_mutex_init(&QSPC_print_lock, NULL);
-	pthread_mutex_init(&QSPC_job_lock, NULL);
-	pthread_cond_init(&QSPC_generator_cond, NULL);
-
-	/* The multithreading logic requires this to start locked. */
-	pthread_mutex_lock(&QSPC_job_lock);
+		for (int64_t counter = 0; counter < QSPC_NUM_COUNTERS;
+		     ++counter)
+			atomic_init(&worker->counters[counter], 0);
+	}
 
-	/* Header for the LaTeX file. */
-	printf("\\documentclass[10pt]{article}\n");
-	printf("\\usepackage{amsmath}\n");
-	printf("\\usepackage[margin=0.1in]{geometry}\n\\begin{document}\n");
+	atomic_init(&search->next_root, 0);
+	QSPC_start_verify(context, hooks);
 
-	for (int64_t index = 0; index < QSPC_NUM_THREADS; ++index) {
-		pthread_create(&threads[index], NULL, worker_thread,
-			       (void *)index);
+	for (int64_t index = 0; index < threads; ++index) {
+		pthread_create(&search->workers[index].thread, NULL,
+			       worker_thread, &search->workers[index]);
 	}
 
-	/* Start generating the job queue. */
-	QSPC_job_queue = malloc(sizeof(struct QSPC_job_entry));
-	QSPC_job_queue->entries = 0;
-	QSPC_job_queue_length = 1;
-	work_recursive_step(parameters, 0);
+	if (hooks->start != NULL) hooks->start(hooks->data);
 
-	/* At this point, the work is nearly done. Wait for each thread to
-	 * finish the queue, and then clean up. */
-	QSPC_keep_working = false;
-	pthread_mutex_unlock(&QSPC_job_lock);
+	for (int64_t index = 0; index < threads; ++index)
+		pthread_join(search->workers[index].thread, NULL);
 
-	for (int64_t index = 0; index < QSPC_NUM_THREADS; ++index) {
-		pthread_join(threads[index], NULL);
+	/* Workers only wait once there are no roots left to claim, for the
+	 * others to finish theirs. They are all joined, so their counters
+	 * can be added to here. */
+	end = QSPC_time_ns();
+
+	for (int64_t index = 0; index < threads; ++index) {
+		struct QSPC_worker *worker = &search->workers[index];
+
+		add_count(worker, QSPC_COUNT_IDLE_TIME, end - worker->finished);
+		add_count(worker, QSPC_COUNT_TOTAL_TIME,
+			  end - worker->finished);
 	}
 
-	QSPC_delete_divisors();
-	pthread_mutex_destroy(&QSPC_print_lock);
-	pthread_mutex_destroy(&QSPC_job_lock);
-	pthread_cond_destroy(&QSPC_generator_cond);
+	QSPC_stop_verify(context);
 
-	/* Footer for the LaTeX file. */
-	printf("\\end{document}\n");
+	if (hooks->stop != NULL) hooks->stop(hooks->data);
 
-	return 0;
+	QSPC_collect_counters(context, counters);
+	free(search->workers);
 }
-
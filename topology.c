@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "qspc.h"
+
+/* The workers of a search can be pinned to CPUs, so that they stay near the
+ * memory they work with. Each thread takes the scratch space for its series
+ * from an arena of its own the first time it needs it, and Linux puts a page
+ * on the NUMA node of the CPU that first touches it, so pinning a worker
+ * before it starts is enough for its arena to be local to it.
+ *
+ * Workers are dealt out to the CPUs so that they fill every physical core of
+ * one NUMA node before the next, and only then share cores with hyperthreads,
+ * which keeps a small search on one socket. The topology comes from sysfs,
+ * and without it the CPUs are just taken in order. */
+
+/* A CPU to run a worker on, with where it sits. */
+struct topology_cpu
+{
+	int64_t sibling;
+	int64_t node;
+	int64_t package;
+	int64_t core;
+	int64_t cpu;
+};
+
+/* The CPUs the workers of a context are dealt out to, in order. */
+struct QSPC_topology
+{
+	int64_t *cpus;
+	int64_t num_cpus;
+	bool pin;
+};
+
+/* Helper function for QSPC_create_topology and QSPC_cpu_list_valid.
+ * Reads a list of CPUs like "0-3,8,10-11" into a set, as sysfs writes them.
+ * Returns false if the text is not such a list, or names a CPU too large for
+ * a set.
+ *   text: The list.
+ *   set: Where the CPUs are written. */
+static bool read_cpu_list(const char *text, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+
+	for (;;) {
+		long long first;
+		long long last;
+		char *end;
+
+		if (!isdigit((unsigned char)*text)) return false;
+
+		first = last = strtoll(text, &end, 10);
+		text = end;
+
+		if (*text == '-') {
+			if (!isdigit((unsigned char)*++text)) return false;
+
+			last = strtoll(text, &end, 10);
+			text = end;
+		}
+
+		if (last < first || last >= CPU_SETSIZE) return false;
+
+		for (long long cpu = first; cpu <= last; ++cpu)
+			CPU_SET((int)cpu, set);
+
+		if (*text == '\n') ++text;
+
+		if (*text == '\0') return true;
+
+		if (*text++ != ',') return false;
+	}
+}
+
+/* Helper function for QSPC_create_topology. Reads a file from sysfs holding
+ * either a number or a list of CPUs. Returns false if it cannot be read.
+ *   path: The file.
+ *   line: Where its first line is written.
+ *   size: The length of this buffer. */
+static bool read_sysfs(const char *path, char *line, int size)
+{
+	FILE *file = fopen(path, "r");
+	bool success;
+
+	if (file == NULL) return false;
+
+	success = fgets(line, size, file) != NULL;
+	fclose(file);
+
+	return success;
+}
+
+/* Helper function for QSPC_create_topology. Reads a number about a CPU from
+ * its topology in sysfs, which is 0 if it is not there. */
+static int64_t read_cpu_number(int64_t cpu, const char *name)
+{
+	char path[128];
+	char line[64];
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%lld/topology/%s",
+		 (long long)cpu, name);
+
+	return read_sysfs(path, line, sizeof(line)) ? strtoll(line, NULL, 10)
+	       : 0;
+}
+
+/* Orders CPUs by how workers are dealt out to them, as described above. */
+static int compare_cpus(const void *pointer1, const void *pointer2)
+{
+	const struct topology_cpu *cpu1 = pointer1;
+	const struct topology_cpu *cpu2 = pointer2;
+	const int64_t keys1[] = {cpu1->sibling, cpu1->node, cpu1->package,
+				 cpu1->core, cpu1->cpu};
+	const int64_t keys2[] = {cpu2->sibling, cpu2->node, cpu2->package,
+				 cpu2->core, cpu2->cpu};
+
+	for (int64_t index = 0; index < 5; ++index) {
+		if (keys1[index] != keys2[index])
+			return keys1[index] < keys2[index] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* Returns true if some CPU in a list given with --cpus is one the process
+ * may run on, or if there is no list.
+ *   text: The list, "all" for every CPU, or NULL. */
+bool QSPC_cpu_list_valid(const char *text)
+{
+	cpu_set_t allowed;
+	cpu_set_t listed;
+
+	if (text == NULL || strcmp(text, "all") == 0) return true;
+
+	if (!read_cpu_list(text, &listed)) return false;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+		CPU_AND(&listed, &listed, &allowed);
+
+	return CPU_COUNT(&listed) > 0;
+}
+
+/* Finds the CPUs the workers of a context can run on and their topology,
+ * and sets the number of workers to one for each of them if it was left at
+ * 0. Called when the context is created, after its settings are checked. */
+void QSPC_create_topology(struct QSPC_context *context)
+{
+	struct QSPC_topology *topology = malloc(sizeof(struct QSPC_topology));
+	const char *list = context->config.cpu_list;
+	struct topology_cpu *cpus;
+	cpu_set_t allowed;
+	cpu_set_t listed;
+	int64_t count = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		CPU_ZERO(&allowed);
+
+		for (long cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN)
+		     && cpu < CPU_SETSIZE; ++cpu)
+			CPU_SET((int)cpu, &allowed);
+	}
+
+	if (list != NULL && strcmp(list, "all") != 0) {
+		read_cpu_list(list, &listed);
+		CPU_AND(&allowed, &allowed, &listed);
+	}
+
+	cpus = malloc((size_t)CPU_COUNT(&allowed) * sizeof(*cpus));
+
+	for (int64_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		cpu_set_t siblings;
+		char path[128];
+		char line[256];
+
+		if (!CPU_ISSET((int)cpu, &allowed)) continue;
+
+		cpus[count] = (struct topology_cpu){
+			.package = read_cpu_number(cpu,
+						   "physical_package_id"),
+			.core = read_cpu_number(cpu, "core_id"),
+			.cpu = cpu
+		};
+
+		/* The first hyperthread of each core comes before the
+		 * others. */
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%lld"
+			 "/topology/thread_siblings_list", (long long)cpu);
+
+		if (read_sysfs(path, line, sizeof(line))
+		    && read_cpu_list(line, &siblings)) {
+			for (int64_t other = 0; other < cpu; ++other)
+				cpus[count].sibling += CPU_ISSET((int)other,
+								 &siblings);
+		}
+
+		++count;
+	}
+
+	/* Nodes only list their CPUs, so each is read once for all of
+	 * them. Node numbers can have gaps, but never large ones. */
+	for (int64_t node = 0, missing = 0; missing < 64; ++node, ++missing) {
+		cpu_set_t members;
+		char path[128];
+		char line[4096];
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%lld/cpulist",
+			 (long long)node);
+
+		if (!read_sysfs(path, line, sizeof(line))
+		    || !read_cpu_list(line, &members))
+			continue;
+
+		missing = 0;
+
+		for (int64_t index = 0; index < count; ++index) {
+			if (CPU_ISSET((int)cpus[index].cpu, &members))
+				cpus[index].node = node;
+		}
+	}
+
+	qsort(cpus, (size_t)count, sizeof(*cpus), compare_cpus);
+
+	topology->cpus = malloc((size_t)count * sizeof(int64_t));
+	topology->num_cpus = count;
+	topology->pin = list != NULL;
+
+	for (int64_t index = 0; index < count; ++index)
+		topology->cpus[index] = cpus[index].cpu;
+
+	free(cpus);
+
+	if (context->config.num_threads == 0)
+		context->config.num_threads = count > 0 ? count : 1;
+
+	context->topology = topology;
+}
+
+/* Frees up the topology of a context. */
+void QSPC_delete_topology(struct QSPC_context *context)
+{
+	free(context->topology->cpus);
+	free(context->topology);
+}
+
+/* Pins the calling thread to the CPU for a worker, if the settings of the
+ * context ask for the workers to be pinned. Workers past the number of CPUs
+ * go round again.
+ *   context: The context of the search.
+ *   index: The number of the worker. */
+void QSPC_pin_thread(struct QSPC_context *context, int64_t index)
+{
+	struct QSPC_topology *topology = context->topology;
+	cpu_set_t set;
+
+	if (!topology->pin || topology->num_cpus == 0) return;
+
+	CPU_ZERO(&set);
+	CPU_SET((int)topology->cpus[index % topology->num_cpus], &set);
+
+	/* Running anywhere is only slower, so a failure is not an error. */
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
@@ -0,0 +1,296 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "qspc.h"
+
+extern void QSPC_delete_arena(void);
+
+/* An identity found at the coefficient bound is only evidence, so each is
+ * handed to a separate pool of threads that checks it again to the much
+ * larger verification bound, leaving the search at its small bound. Only
+ * identities that pass are reported.
+ *
+ * A root must not be reported finished while any of its identities are
+ * still being checked, or a checkpoint could lose them. So the first
+ * identity of a root takes a hold on it, of which the worker searching the
+ * root keeps one share and each identity queued another, and whoever gives
+ * up the last share finishes the root. */
+
+/* The shares of a root still held. */
+struct QSPC_root_hold
+{
+	atomic_int_fast64_t shares;
+};
+
+/* An identity waiting to be verified. */
+struct verify_job
+{
+	struct verify_job *next;
+	struct QSPC_root_hold *hold;
+	int64_t root;
+	int64_t period;
+	int64_t exceptions;
+	int64_t parameters[QSPC_PARAMETER_LENGTH];
+	int64_t signature[QSPC_MAX_SIGNATURE];
+};
+
+/* The pool of a context. Identities are rare, so a list behind a lock is
+ * plenty for the queue. */
+struct QSPC_verify
+{
+	const struct QSPC_search_hooks *hooks;
+	pthread_t *threads;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct verify_job *head;
+	struct verify_job **tail;
+	bool stop;
+
+	/* Totals over every thread of the pool. */
+	atomic_int_fast64_t verified;
+	atomic_int_fast64_t failed;
+	atomic_int_fast64_t time;
+};
+
+/* Returns the number of coefficients identities found with the given
+ * settings are verified to. This is just the coefficient bound if the
+ * verification bound is no larger.
+ *   config: The settings of the search. */
+int64_t QSPC_verified_bound(const struct QSPC_config *config)
+{
+	return config->verify_bound > config->coefficient_bound
+	       ? config->verify_bound : config->coefficient_bound;
+}
+
+/* Helper function for QSPC_release_root and verify_main. Gives up a share
+ * of the hold on a root, finishing the root if it was the last. */
+static void release_share(struct QSPC_context *context,
+			  struct QSPC_root_hold *hold, int64_t root)
+{
+	const struct QSPC_search_hooks *hooks = context->verify->hooks;
+
+	if (atomic_fetch_sub_explicit(&hold->shares, 1,
+				      memory_order_acq_rel) != 1) return;
+
+	if (hooks->finish_root != NULL) hooks->finish_root(hooks->data, root);
+
+	free(hold);
+}
+
+/* Entry point for each verification thread. */
+static void *verify_main(void *argument)
+{
+	struct QSPC_context *context = argument;
+	struct QSPC_verify *verify = context->verify;
+	const struct QSPC_search_hooks *hooks = context->verify->hooks;
+	int64_t bound = QSPC_verified_bound(&context->config);
+
+	for (;;) {
+		struct verify_job *job;
+		int64_t start;
+		bool passed;
+
+		pthread_mutex_lock(&verify->lock);
+
+		while (verify->head == NULL && !verify->stop)
+			pthread_cond_wait(&verify->cond, &verify->lock);
+
+		/* Every identity is verified before the pool stops. */
+		job = verify->head;
+
+		if (job == NULL) {
+			pthread_mutex_unlock(&verify->lock);
+			break;
+		}
+
+		verify->head = job->next;
+
+		if (verify->head == NULL) verify->tail = &verify->head;
+
+		pthread_mutex_unlock(&verify->lock);
+
+		start = QSPC_time_ns();
+		passed = QSPC_verify_identity(job->parameters, job->signature,
+					      job->period, job->exceptions,
+					      bound);
+		atomic_fetch_add(&verify->time, QSPC_time_ns() - start);
+		atomic_fetch_add(passed ? &verify->verified : &verify->failed,
+				 1);
+
+		if (passed && hooks->identity != NULL) {
+			hooks->identity(hooks->data, job->root,
+					job->parameters, job->signature,
+					job->period, job->exceptions, bound);
+		}
+
+		release_share(context, job->hold, job->root);
+		free(job);
+	}
+
+	QSPC_delete_arena();
+
+	return NULL;
+}
+
+/* Hands an identity found by a worker to the pool to be verified, or
+ * reports it right away if there is nothing to verify it to.
+ *   context: The context of the search.
+ *   hold: The hold the worker has on the root, which is taken with the
+ *     first identity of the root, and NULL before that.
+ *   root: The number of the root the identity was found in.
+ *   parameters: The series parameters.
+ *   signature: The pattern of powers for the product, followed by its
+ *     exceptions.
+ *   period: The length of the pattern.
+ *   exceptions: The number of exceptions. */
+void QSPC_submit_identity(struct QSPC_context *context,
+			  struct QSPC_root_hold **hold, int64_t root,
+			  int64_t *parameters, int64_t *signature,
+			  int64_t period, int64_t exceptions)
+{
+	const struct QSPC_search_hooks *hooks = context->verify->hooks;
+	struct QSPC_verify *verify = context->verify;
+	struct verify_job *job;
+
+	if (context->config.verify_bound <= context->config.coefficient_bound) {
+		if (hooks->identity != NULL) {
+			hooks->identity(hooks->data, root, parameters,
+					signature, period, exceptions,
+					context->config.coefficient_bound);
+		}
+
+		return;
+	}
+
+	if (*hold == NULL) {
+		*hold = malloc(sizeof(struct QSPC_root_hold));
+		atomic_init(&(*hold)->shares, 1);
+	}
+
+	atomic_fetch_add_explicit(&(*hold)->shares, 1, memory_order_relaxed);
+
+	job = malloc(sizeof(struct verify_job));
+	job->next = NULL;
+	job->hold = *hold;
+	job->root = root;
+	job->period = period;
+	job->exceptions = exceptions;
+
+	for (int64_t index = 0; index < QSPC_PARAMETER_LENGTH; ++index)
+		job->parameters[index] = parameters[index];
+
+	for (int64_t index = 0; index < period + 2 * exceptions; ++index)
+		job->signature[index] = signature[index];
+
+	pthread_mutex_lock(&verify->lock);
+	*verify->tail = job;
+	verify->tail = &job->next;
+	pthread_cond_signal(&verify->cond);
+	pthread_mutex_unlock(&verify->lock);
+}
+
+/* Finishes a root once the worker searching it is done, or leaves that to
+ * the pool if some of its identities are still being verified.
+ *   context: The context of the search.
+ *   hold: The hold the worker has on the root, or NULL if it found no
+ *     identities to verify.
+ *   root: The number of the root. */
+void QSPC_release_root(struct QSPC_context *context,
+		       struct QSPC_root_hold *hold, int64_t root)
+{
+	const struct QSPC_search_hooks *hooks = context->verify->hooks;
+
+	if (hold != NULL) {
+		release_share(context, hold, root);
+		return;
+	}
+
+	if (hooks->finish_root != NULL) hooks->finish_root(hooks->data, root);
+}
+
+/* Starts the verification threads of a context, if identities are to be
+ * verified.
+ *   context: The context of the search.
+ *   hooks: What verified identities and finished roots are reported to. */
+void QSPC_start_verify(struct QSPC_context *context,
+		       const struct QSPC_search_hooks *hooks)
+{
+	struct QSPC_verify *verify = context->verify;
+
+	verify->hooks = hooks;
+
+	if (context->config.verify_bound <= context->config.coefficient_bound)
+		return;
+
+	verify->head = NULL;
+	verify->tail = &verify->head;
+	verify->stop = false;
+	verify->threads = malloc((size_t)context->config.verify_threads
+				 * sizeof(pthread_t));
+
+	for (int64_t index = 0; index < context->config.verify_threads;
+	     ++index)
+		pthread_create(&verify->threads[index], NULL, verify_main,
+			       context);
+}
+
+/* Verifies every identity still queued, and stops the verification threads
+ * of a context. No more identities can be submitted once this is called. */
+void QSPC_stop_verify(struct QSPC_context *context)
+{
+	struct QSPC_verify *verify = context->verify;
+
+	if (context->config.verify_bound <= context->config.coefficient_bound)
+		return;
+
+	pthread_mutex_lock(&verify->lock);
+	verify->stop = true;
+	pthread_cond_broadcast(&verify->cond);
+	pthread_mutex_unlock(&verify->lock);
+
+	for (int64_t index = 0; index < context->config.verify_threads;
+	     ++index)
+		pthread_join(verify->threads[index], NULL);
+
+	free(verify->threads);
+}
+
+/* Adds the counters of the verification threads of a context to those of
+ * the workers.
+ *   context: The context of the search.
+ *   counters: The QSPC_NUM_COUNTERS totals to add to. */
+void QSPC_add_verify_counters(struct QSPC_context *context,
+			      int64_t *counters)
+{
+	struct QSPC_verify *verify = context->verify;
+
+	counters[QSPC_COUNT_VERIFIED] += atomic_load(&verify->verified);
+	counters[QSPC_COUNT_VERIFY_FAILED] += atomic_load(&verify->failed);
+	counters[QSPC_COUNT_VERIFY_TIME] += atomic_load(&verify->time);
+}
+
+/* Sets up the verification pool of a context, without starting it. Called
+ * when the context is created. */
+void QSPC_create_verify(struct QSPC_context *context)
+{
+	struct QSPC_verify *verify = malloc(sizeof(struct QSPC_verify));
+
+	pthread_mutex_init(&verify->lock, NULL);
+	pthread_cond_init(&verify->cond, NULL);
+	verify->head = NULL;
+	verify->tail = &verify->head;
+	atomic_init(&verify->verified, 0);
+	atomic_init(&verify->failed, 0);
+	atomic_init(&verify->time, 0);
+	context->verify = verify;
+}
+
+/* Frees up the verification pool of a context. */
+void QSPC_delete_verify(struct QSPC_context *context)
+{
+	pthread_mutex_destroy(&context->verify->lock);
+	pthread_cond_destroy(&context->verify->cond);
+	free(context->verify);
+}
@@ -0,0 +1,212 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "qspc.h"
+
+extern int64_t QSPC_arena_mark(void);
+extern void *QSPC_arena_alloc(int64_t);
+extern void QSPC_arena_release(int64_t);
+
+/* These functions mirror those in algebra.c, but with __int128 coefficients
+ * for the series that overflow int64_t. Every operation is still checked,
+ * and each function returns false on overflow. Nothing here is cached,
+ * since only a few combinations should ever need it. */
+
+/* Multiplies a truncated series in place by the binomial $1 - s q^k$.
+ *   power: The value k, which must be at least 1.
+ *   sign: The value s, which is 1 or -1.
+ *   series: The coefficients of the series, which are overwritten.
+ *   bound: The length of this array. */
+static bool multiply_binomial(int64_t power, int64_t sign, __int128 *series,
+			      int64_t bound)
+{
+	bool overflow = false;
+
+	for (int64_t index = bound - 1; index >= power; --index) {
+		if (sign == 1) {
+			overflow |= __builtin_sub_overflow(series[index],
+				series[index - power], &series[index]);
+		} else {
+			overflow |= __builtin_add_overflow(series[index],
+				series[index - power], &series[index]);
+		}
+	}
+
+	return !overflow;
+}
+
+/* Divides a truncated series in place by the binomial $1 - s q^k$. The
+ * parameters are the same as for multiply_binomial. */
+static bool divide_binomial(int64_t power, int64_t sign, __int128 *series,
+			    int64_t bound)
+{
+	bool overflow = false;
+
+	for (int64_t index = power; index < bound; ++index) {
+		if (sign == 1) {
+			overflow |= __builtin_add_overflow(series[index],
+				series[index - power], &series[index]);
+		} else {
+			overflow |= __builtin_sub_overflow(series[index],
+				series[index - power], &series[index]);
+		}
+	}
+
+	return !overflow;
+}
+
+/* Helper function for QSPC_build_series_wide. Works the same way as
+ * extend_series_term in algebra.c. */
+static bool extend_series_term(int64_t *parameters, int64_t *factors,
+			       __int128 *term, int64_t bound,
+			       int64_t summation_index)
+{
+	bool success = true;
+
+	for (int64_t index1 = 0; index1 < 2 * QSPC_MAX_NUM_QPS; ++index1) {
+		int64_t *symbol = &parameters[4 * index1];
+		int64_t target = symbol[0] * summation_index + symbol[1];
+
+		/* Skip to the denominator on the first empty symbol. */
+		if (symbol[0] == 0) {
+			if (index1 >= QSPC_MAX_NUM_QPS) break;
+
+			index1 = QSPC_MAX_NUM_QPS - 1;
+			continue;
+		}
+
+		for (; factors[index1] < target; ++factors[index1]) {
+			int64_t power = symbol[2] + symbol[3]
+				      * factors[index1];
+
+			if (power >= bound) continue;
+
+			/* The numerator symbols are $(-q^a; q^b)$, and the
+			 * denominator symbols are $(q^a; q^b)$. */
+			if (index1 < QSPC_MAX_NUM_QPS) {
+				success &= multiply_binomial(power, -1, term,
+							     bound);
+			} else {
+				success &= divide_binomial(power, 1, term,
+							   bound);
+			}
+		}
+	}
+
+	return success;
+}
+
+/* Computes the truncated coefficients of a q-series as QSPC_build_series
+ * does, but with __int128 coefficients. Returns false on overflow.
+ *   parameters: The parameters that encode the series.
+ *   result: The array the coefficients of the terms are written to.
+ *   bound: The length of this array, and the number of coefficients found. */
+bool QSPC_build_series_wide(int64_t *parameters, __int128 *result,
+			    int64_t bound)
+{
+	int64_t factors[2 * QSPC_MAX_NUM_QPS];
+	int64_t mark = QSPC_arena_mark();
+	__int128 *term = QSPC_arena_alloc(bound * (int64_t)sizeof(__int128));
+	bool overflow = false;
+
+	for (int64_t index = 0; index < bound; ++index) result[index] = 0;
+
+	for (int64_t index = 0; index < 2 * QSPC_MAX_NUM_QPS; ++index)
+		factors[index] = 0;
+
+	term[0] = 1;
+
+	for (int64_t index = 1; index < bound; ++index) term[index] = 0;
+
+	for (int64_t index1 = 0;; ++index1) {
+		int64_t offset = QSPC_series_offset(parameters, index1);
+
+		if (offset >= bound) break;
+
+		overflow |= !extend_series_term(parameters, factors, term,
+						bound - offset, index1);
+
+		for (int64_t index2 = 0; index2 < bound - offset; ++index2) {
+			if (QSPC_series_sign(parameters, index1) == 1) {
+				overflow |= __builtin_add_overflow(
+					result[index2 + offset], term[index2],
+					&result[index2 + offset]);
+			} else {
+				overflow |= __builtin_sub_overflow(
+					result[index2 + offset], term[index2],
+					&result[index2 + offset]);
+			}
+		}
+	}
+
+	QSPC_arena_release(mark);
+
+	return !overflow;
+}
+
+extern int64_t QSPC_mobius_divisors(struct QSPC_context *, int64_t,
+				    int64_t **, int64_t **);
+
+/* Factors a truncated series as QSPC_find_product_form does, but with
+ * __int128 coefficients. The return value is also the same, where a power
+ * that does not fit in int64_t counts as an overflow.
+ *   context: The context whose divisors are used.
+ *   series: The series to be factored.
+ *   powers: The list of geometric series powers.
+ *   bound: The length of the series array. */
+int64_t QSPC_find_product_form_wide(struct QSPC_context *context,
+				    __int128 *series, int64_t *powers,
+				    int64_t bound)
+{
+	int64_t mark = QSPC_arena_mark();
+	__int128 *derivative = QSPC_arena_alloc(bound
+		* (int64_t)sizeof(__int128));
+	int64_t exact = bound;
+
+	powers[0] = 0;
+
+	for (int64_t index1 = 1; index1 < bound; ++index1) {
+		__int128 value;
+		__int128 power = 0;
+		__int128 term;
+		int64_t length;
+		int64_t *divisors;
+		int64_t *signs;
+		bool overflow = __builtin_mul_overflow((__int128)index1,
+						       series[index1], &value);
+
+		for (int64_t index2 = 1; index2 < index1; ++index2) {
+			overflow |= __builtin_mul_overflow(derivative[index2],
+				series[index1 - index2], &term);
+			overflow |= __builtin_sub_overflow(value, term, &value);
+		}
+
+		derivative[index1] = value;
+		length = QSPC_mobius_divisors(context, index1, &divisors,
+					      &signs);
+
+		for (int64_t index2 = 0; index2 < length; ++index2) {
+			term = derivative[divisors[index2]];
+
+			if (signs[index2] > 0) {
+				overflow |= __builtin_add_overflow(power, term,
+								   &power);
+			} else {
+				overflow |= __builtin_sub_overflow(power, term,
+								   &power);
+			}
+		}
+
+		power /= index1;
+
+		if (overflow || power > INT64_MAX || power < INT64_MIN) {
+			exact = index1;
+			break;
+		}
+
+		powers[index1] = (int64_t)power;
+	}
+
+	QSPC_arena_release(mark);
+
+	return exact;
+}